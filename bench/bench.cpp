@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../src/assembler.hpp"
+#include "../src/lexer.hpp"
+#include "../src/objformat.hpp"
+#include "generator.hpp"
+
+/*
+ * Times the assembler phases on generated sources of growing size.
+ * usage: bench [--sizes n,n,...] [--repeat n] [generator options]
+ *
+ * classify - Lexer::classify over every line (validateRegex without the encoder)
+ * encode   - parse minus classify (decypherRegex)
+ * literals - resolveLiterals (evaluateLiteral)
+ * backpatch, result - backpatch and buildResult
+ * emit     - text object formatting (generateObj output stage)
+ */
+
+typedef std::chrono::steady_clock benchClock;
+
+typedef struct {
+	const char *name;
+	double seconds;
+	size_t bytes;	// source bytes, object bytes for emit
+} phaseTime;
+
+double since(benchClock::time_point start) {
+	return std::chrono::duration<double>(benchClock::now() - start).count();
+}
+
+double classifyAll(std::string_view source) {
+	lineMatch match;
+	size_t position = 0, accepted = 0;
+	auto start = benchClock::now();
+	while (position < source.size()) {
+		auto end = source.find('\n', position);
+		if (end == std::string_view::npos) {
+			end = source.size();
+		}
+		accepted += Lexer::classify(source.substr(position, end - position), match);
+		position = end + 1;
+	}
+	auto seconds = since(start);
+	if (accepted == 0) {
+		std::cerr << "nothing classified" << std::endl;
+	}
+	return seconds;
+}
+
+std::vector<phaseTime> measure(Assembler& assembler, const std::string& source) {
+	assemblyResult result;
+	std::string text;
+
+	auto classify = classifyAll(source);
+
+	assembler.reset();
+	auto start = benchClock::now();
+	assembler.parse(source);
+	auto parse = since(start);
+
+	start = benchClock::now();
+	assembler.resolveLiterals();
+	auto literals = since(start);
+
+	start = benchClock::now();
+	assembler.backpatch();
+	auto backpatch = since(start);
+
+	start = benchClock::now();
+	assembler.buildResult(result);
+	auto build = since(start);
+
+	start = benchClock::now();
+	ObjectFormat::formatText(result, text);
+	auto emit = since(start);
+
+	return { { "classify", classify, source.size() }, { "encode", std::max(0.0, parse - classify), source.size() },
+			{ "literals", literals, source.size() }, { "backpatch", backpatch, source.size() },
+			{ "result", build, source.size() }, { "emit", emit, text.size() },
+			{ "total", parse + literals + backpatch + build + emit, source.size() } };
+}
+
+int main(int argc, char *argv[]) {
+	generatorOptions options;
+	std::vector<uint64_t> sizes = { 1000, 10000, 100000, 1000000 };
+	auto repeat = 3;
+	for (auto i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+			sizes.clear();
+			std::stringstream list(argv[++i]);
+			std::string size;
+			while (std::getline(list, size, ',')) {
+				sizes.push_back(std::stoull(size));
+			}
+		} else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = std::max(1, std::stoi(argv[++i]));
+		} else if (!parseGeneratorOption(argc, argv, i, options)) {
+			std::cerr << "usage: bench [--sizes n,n,...] [--repeat n] " << generatorUsage() << std::endl;
+			return 2;
+		}
+	}
+
+	std::cout << std::setw(10) << "lines" << std::setw(12) << "phase" << std::setw(12) << "ms"
+			<< std::setw(14) << "Mlines/s" << std::setw(12) << "MB/s" << std::endl;
+	Assembler assembler;
+	for (auto lines : sizes) {
+		options.lines = lines;
+		auto source = generateSource(options);
+
+		// best of repeat runs, per phase
+		std::vector<phaseTime> best;
+		for (auto run = 0; run < repeat; run++) {
+			std::vector<phaseTime> times;
+			times = measure(assembler, source);
+			if (!assembler.getDiagnostics().empty()) {
+				std::cerr << "generated source failed" << std::endl;
+				assembler.printDiagnostics(std::cerr);
+				return assembler.getDiagnostics().front().code;
+			}
+			if (best.empty()) {
+				best = times;
+			}
+			for (size_t i = 0; i < times.size(); i++) {
+				best[i].seconds = std::min(best[i].seconds, times[i].seconds);
+			}
+		}
+
+		for (auto& phase : best) {
+			auto seconds = std::max(phase.seconds, 1e-9);
+			std::cout << std::setw(10) << lines << std::setw(12) << phase.name
+					<< std::setw(12) << std::fixed << std::setprecision(3) << phase.seconds * 1e3
+					<< std::setw(14) << std::setprecision(2) << lines / seconds / 1e6
+					<< std::setw(12) << std::setprecision(1) << phase.bytes / seconds / 1e6 << std::endl;
+		}
+	}
+	return 0;
+}
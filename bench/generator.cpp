@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "generator.hpp"
+
+namespace {
+
+// a section never grows past this, the longest generated line takes 16 bytes
+constexpr uint32_t SECTION_LIMIT = 65535 - 16;
+// forward and backward references stay this close, like real code
+constexpr uint64_t REFERENCE_WINDOW = 1000;
+
+class Generator {
+public:
+	Generator(const generatorOptions& options) : options(options), rng(options.seed) {
+		labels = (options.lines + options.labelEvery - 1) / options.labelEvery;
+	}
+
+	std::string run();
+private:
+	double chance() {
+		return std::uniform_real_distribution<double>(0, 1)(rng);
+	}
+
+	uint64_t pick(uint64_t low, uint64_t high) {
+		return std::uniform_int_distribution<uint64_t>(low, high)(rng);
+	}
+
+	void number(uint64_t value) {
+		out.append(std::to_string(value));
+	}
+
+	void label(uint64_t index) {
+		out.push_back('l');
+		number(index);
+	}
+
+	void reg() {
+		out.append("%r");
+		number(pick(0, 5));
+	}
+
+	void section();
+	void label();
+	void symbol();
+	void immediate();
+	uint32_t instruction();
+	uint32_t directive();
+
+	const generatorOptions& options;
+	std::mt19937_64 rng;
+	std::string out;
+	uint64_t labels;
+	uint64_t current = 0;	// label index of the current line
+	uint32_t sectionCount = 0;
+};
+
+// letters only, seca, secb ... secz, secba ...
+void Generator::section() {
+	std::string name;
+	auto index = sectionCount++;
+	do {
+		name.insert(name.begin(), 'a' + index % 26);
+		index /= 26;
+	} while (index);
+	out.append(".sec").append(name).push_back('\n');
+}
+
+// a label defined somewhere in the file, forward with the configured share
+void Generator::label() {
+	if (chance() < options.forward && current + 1 < labels) {
+		label(pick(current + 1, std::min(labels - 1, current + REFERENCE_WINDOW)));
+	} else {
+		label(pick(current > REFERENCE_WINDOW ? current - REFERENCE_WINDOW : 0, current));
+	}
+}
+
+void Generator::symbol() {
+	if (options.externs && chance() < 0.05) {
+		out.push_back('x');
+		number(pick(0, options.externs - 1));
+	} else {
+		label();
+	}
+}
+
+void Generator::immediate() {
+	out.push_back('$');
+	if (options.equs && chance() < options.symbolic) {
+		out.push_back('e');
+		number(pick(0, options.equs - 1));
+	} else {
+		number(pick(1, 30000));
+	}
+}
+
+// returns the encoded size
+uint32_t Generator::instruction() {
+	static const char *arithmetic[] = { "mov", "add", "sub", "cmp", "and", "or", "xor", "test" };
+	static const char *jumps[] = { "jmp", "jeq", "jne", "jgt", "call" };
+	auto form = pick(0, 9);
+	switch (form) {
+	case 0:
+		out.append(chance() < 0.5 ? "halt" : "ret");
+		return 1;
+	case 1:
+		out.append(chance() < 0.5 ? "push " : "pop ");
+		reg();
+		return 2;
+	case 2:
+		out.append(jumps[pick(0, 4)]).push_back(' ');
+		if (chance() < options.symbolic) {
+			out.push_back('*');
+			label();
+			out.append("(%pc)");
+		} else {
+			label();
+		}
+		return 4;
+	case 3:
+		out.append(arithmetic[pick(0, 7)]).push_back(' ');
+		reg();
+		out.append(", ");
+		reg();
+		return 3;
+	case 4:
+		out.append("movb $");
+		number(pick(1, 100));
+		out.append(", ");
+		reg();
+		return 4;
+	default:
+		out.append(arithmetic[pick(0, 7)]).push_back(' ');
+		if (chance() >= options.symbolic) {
+			immediate();
+		} else if (chance() < 0.5) {
+			symbol();
+		} else {
+			label();
+			out.append("(%pc)");
+		}
+		out.append(", ");
+		if (chance() < 0.2) {
+			symbol();
+		} else {
+			reg();
+		}
+		return 7;
+	}
+}
+
+uint32_t Generator::directive() {
+	auto form = pick(0, 3);
+	if (form == 0) {
+		auto count = pick(1, 16);
+		out.append(".skip ");
+		number(count);
+		return count;
+	}
+	auto items = pick(1, 4);
+	if (form == 1) {
+		out.append(".byte ");
+		for (uint64_t i = 0; i < items; i++) {
+			if (i) {
+				out.push_back(',');
+			}
+			number(pick(1, 127));
+		}
+		return items;
+	}
+	out.append(".word ");
+	for (uint64_t i = 0; i < items; i++) {
+		if (i) {
+			out.push_back(',');
+		}
+		if (chance() < options.symbolic) {
+			symbol();
+		} else {
+			number(pick(1, 30000));
+		}
+	}
+	return items * 2;
+}
+
+std::string Generator::run() {
+	out.reserve(options.lines * 24 + 64);
+
+	for (uint32_t i = 0; i < options.globals && labels; i++) {
+		out.append(".global ");
+		label(pick(0, labels - 1));
+		out.push_back('\n');
+	}
+	for (uint32_t i = 0; i < options.externs; i++) {
+		out.append(".extern x");
+		number(i);
+		out.push_back('\n');
+	}
+	for (uint32_t i = 0; i < options.equs; i++) {
+		out.append(".equ e");
+		number(i);
+		out.push_back(',');
+		auto form = pick(0, 2);
+		if (form == 0 || !labels) {
+			number(pick(1, 30000));
+		} else if (form == 1 || !options.externs) {
+			label(pick(0, labels - 1));
+			out.push_back('+');
+			number(pick(1, 100));
+		} else {
+			out.push_back('x');
+			number(pick(0, options.externs - 1));
+			out.push_back('+');
+			number(pick(1, 100));
+		}
+		out.push_back('\n');
+	}
+
+	auto perSection = (options.lines + std::max(1u, options.sections) - 1) / std::max(1u, options.sections);
+	uint32_t size = 0;
+	for (uint64_t line = 0; line < options.lines; line++) {
+		if (line % perSection == 0 || size > SECTION_LIMIT) {
+			section();
+			size = 0;
+		}
+		current = line / options.labelEvery;
+		if (line % options.labelEvery == 0) {
+			label(current);
+			out.append(": ");
+		} else {
+			out.push_back(' ');
+		}
+		size += (chance() < options.directives) ? directive() : instruction();
+		out.push_back('\n');
+	}
+	out.append(".end\n");
+	return out;
+}
+
+}
+
+std::string generateSource(const generatorOptions& options) {
+	generatorOptions checked = options;
+	checked.labelEvery = std::max(1u, checked.labelEvery);
+	return Generator(checked).run();
+}
+
+bool parseGeneratorOption(int argc, char *argv[], int& i, generatorOptions& options) {
+	if (i + 1 >= argc || strncmp(argv[i], "--", 2) != 0) {
+		return false;
+	}
+	std::string name(argv[i] + 2);
+	std::string value(argv[i + 1]);
+	if (name == "lines") {
+		options.lines = std::stoull(value);
+	} else if (name == "directives") {
+		options.directives = std::stod(value);
+	} else if (name == "forward") {
+		options.forward = std::stod(value);
+	} else if (name == "symbolic") {
+		options.symbolic = std::stod(value);
+	} else if (name == "equ") {
+		options.equs = std::stoul(value);
+	} else if (name == "extern") {
+		options.externs = std::stoul(value);
+	} else if (name == "global") {
+		options.globals = std::stoul(value);
+	} else if (name == "sections") {
+		options.sections = std::stoul(value);
+	} else if (name == "label-every") {
+		options.labelEvery = std::stoul(value);
+	} else if (name == "seed") {
+		options.seed = std::stoul(value);
+	} else {
+		return false;
+	}
+	i++;
+	return true;
+}
+
+const char *generatorUsage() {
+	return "[--lines n] [--directives ratio] [--forward ratio] [--symbolic ratio] [--equ n] [--extern n]"
+			" [--global n] [--sections n] [--label-every n] [--seed n]";
+}
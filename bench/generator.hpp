@@ -0,0 +1,32 @@
+#ifndef _generator_hpp_
+#define _generator_hpp_
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Shape of a synthetic source. Every generated source assembles without errors:
+ * all referenced labels are defined, sections are split before they reach 64KB.
+ */
+typedef struct {
+	uint64_t lines = 10000;
+	double directives = 0.2;	// share of .word/.byte/.skip lines
+	double forward = 0.3;	// share of label references to a label defined later
+	double symbolic = 0.5;	// share of operands naming a symbol instead of a number
+	uint32_t equs = 16;
+	uint32_t externs = 8;
+	uint32_t globals = 8;
+	uint32_t sections = 4;
+	uint32_t labelEvery = 4;	// a label on every n-th line
+	uint32_t seed = 1;
+} generatorOptions;
+
+std::string generateSource(const generatorOptions& options);
+
+// consumes "--name value" at argv[i], false if it isn't a generator option
+bool parseGeneratorOption(int argc, char *argv[], int& i, generatorOptions& options);
+
+// --lines n --directives r --forward r --symbolic r --equ n --extern n --global n --sections n --label-every n --seed n
+const char *generatorUsage();
+
+#endif
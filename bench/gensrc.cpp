@@ -0,0 +1,35 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "generator.hpp"
+
+/*
+ * Writes a synthetic source that assembles cleanly.
+ * usage: gensrc [-o out.s] [generator options]
+ */
+int main(int argc, char *argv[]) {
+	generatorOptions options;
+	std::string output;
+	for (auto i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		} else if (!parseGeneratorOption(argc, argv, i, options)) {
+			std::cerr << "usage: gensrc [-o out.s] " << generatorUsage() << std::endl;
+			return 2;
+		}
+	}
+
+	auto source = generateSource(options);
+	if (output == "") {
+		std::cout.write(source.data(), source.size());
+		return 0;
+	}
+	std::ofstream out(output, std::ios::out | std::ios::binary);
+	if (!out.good()) {
+		std::cerr << "Unable to create " << output << std::endl;
+		return 1;
+	}
+	out.write(source.data(), source.size());
+	return 0;
+}
@@ -2,453 +2,1023 @@
 #include <iomanip>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#include <unistd.h>
 
 #include "assembler.hpp"
 #include "auxiliary.hpp"
+#include "lexer.hpp"
+#include "objformat.hpp"
 
-const char *regexes[] ={
-		"^[ 	]*(?:#.*)*$",
-		"^[ 	]*([a-zA-Z_][a-zA-Z_0-9]*):[ 	]*(?:#.*)*$",
-		"^(?:\\.section[ 	]+)?\\.([a-zA-Z]+)[ 	]*(?:#.*)*$",
-		"^\\.equ[ 	]+([a-z_A-Z][a-zA-Z0-9_]*),[ 	]*([\\+-]?[0-9a-zA-Z_]+(?:[\\+-][0-9a-zA-Z_]+)*)[ 	]*(?:#.*)*$",
-		"^\\.global[ 	]+((?:[a-zA-Z_][a-zA-Z_0-9]*)(?:,[a-zA-Z_][a-zA-Z_0-9]*)*)[ 	]*(?:#.*)*$",
-		"^\\.extern[ 	]+((?:[a-zA-Z_][a-zA-Z_0-9]*)(?:,[a-zA-Z_][a-zA-Z_0-9]*)*)[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*\\.byte[ 	]+((?:-?[a-zA-Z_0-9]+)(?:,-?[a-zA-Z_0-9]+)*)[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*\\.word[ 	]+((?:-?[a-zA-Z_0-9]+)(?:,-?[a-zA-Z_0-9]+)*)[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*\\.skip[ 	]+((?:0x)?[0-9a-fA-F]+)[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*(halt|iret|ret)[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*(int|call|jmp|jeq|jne|jgt|push|pop)[ 	]+((?:(?:\\*)?(?:0x|-)?[1-9a-fA-F][0-9a-fA-F]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:(?:\\*)?[a-zA-Z_][a-zA-Z_0-9]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:(?:\\*)?%(?:r[0-7]|pc|sp))|(?:(?:\\*)?\\(%(?:r[0-7]|pc|sp)\\)))[ 	]*(?:#.*)*$",
-		"^[ 	]*(?:([a-zA-Z_][a-zA-Z_0-9]*):)?[ 	]*(xchg[bw]?|not[bw]?|mov[bw]?|add[bw]?|sub[bw]?|mul[bw]?|div[bw]?|cmp[bw]?|and[bw]?|or[bw]?|xor[bw]?|test[bw]?|shl[bw]?|shr[bw]?)[ 	]+((?:(?:\\$)?(?:0x|-)?[0-9a-fA-F]+(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:(?:\\$)?[a-zA-Z_][a-zA-Z_0-9]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:%(?:r[0-7]|pc|sp)[lh]?)|(?:\\(%(?:r[0-7]|pc|sp)\\))),[ 	]*((?:(?:\\$)?(?:0x|-)?[0-9a-fA-F]+(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:(?:\\$)?[a-zA-Z_][a-zA-Z_0-9]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(?:%(?:r[0-7]|pc|sp)[lh]?)|(?:\\(%(?:r[0-7]|pc|sp)\\)))[ 	]*(?:#.*)*$"
-};
-
-const char* jumpRegex = "((?:\\*)?(?:0x[0-9a-fA-F]+|-?[1-9][0-9]*)(?:\\(%(?:r[0-7]|pc|sp)\\))?)|((?:\\*)?[a-zA-Z_][a-zA-Z_0-9]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(\\*%(?:r[0-7]|pc|sp))|(\\*\\(%(?:r[0-7]|pc|sp)\\))";
-const char* instrOperandRegex = "((?:\\$)?(?:0x[0-9a-fA-F]+|-?[0-9]+)(?:\\(%(?:r[0-7]|pc|sp)\\))?)|((?:\\$)?[a-zA-Z_][a-zA-Z_0-9]*(?:\\(%(?:r[0-7]|pc|sp)\\))?)|(%(?:r[0-7]|pc|sp)[lh]?)|(\\(%(?:r[0-7]|pc|sp)\\))";
-
-void returnErrorCode(const int err) {
-	printf("**** Application returned error code %d ****", err);
-	exit(err);
+Assembler::Assembler() {
+	objectFormat = OBJ_TEXT;
+	expansionBuffers.resize(MAX_EXPANSION_DEPTH);
+	reset();
 }
 
-Assembler::Assembler() {
+Assembler::~Assembler() {
+	logger.close();
+	asmFile.close();
+	objectFile.close();
+}
 
+void Assembler::reset() {
+	stats.clear();
+	resetPass();
+}
+
+void Assembler::resetPass() {
 	readingLineNumber = 0;
-	currentSection = "UNDEFINED";
-	currentSectionSymbolNumber = 0;
+	currentSectionSymbolNumber = UNDEFINED_SECTION;
+	currentSectionIndex = 0;
 	symbolNumber = 0;
 	locationCounter = 0;
 	foundEnd = false;
-	logFile.open("assemblyLog.txt", std::ios::out);
-	if (!logFile.good()) {
-		std::cout << "Unable to open log file. Abort.\n" << std::endl;
-		returnErrorCode(ERR_FOPEN);
+	recording = false;
+	defining = BLOCK_NONE;
+	expansions = 0;
+	expansionDepth = 0;
+	sourceFiles.assign(1, "");
+	currentFile = 0;
+	includeStack.clear();
+
+	diagnostics.clear();
+	stopped = false;
+	names.clear();
+	identifiers.clear();
+	openBackpatches = 0;
+	literals.clear();
+	compiledLiterals.clear();
+	expressionCode.clear();
+	macroNames.clear();
+	macros.clear();
+	macroHash = 0;
+	sections.clear();
+	sections.push_back( { 0, UNDEFINED_SECTION, 0, SectionBuffer(&codeArena), { }, 0, false, 0, 0 });
+	sectionIndex.assign(1, 0);
+	code = &sections[0].code;
+	relaxSymbols.clear();
+	if (spill.isOpen()) {
+		spill.clear();
 	}
-	sectionTable.insert( { currentSection, { locationCounter,
-			currentSectionSymbolNumber } });
-	sectionTranslation.insert({0, "UNDEFINED"});
+}
 
-	logger("Created Assembler class object\n");
+uint32_t Assembler::identify(std::string_view name) {
+	auto id = names.intern(name);
+	if (id >= identifiers.size()) {
+		identifiers.resize(id + 1);
+	}
+	if (recording && (id >= recordStamp.size() || recordStamp[id] != recordGeneration)) {
+		recordIdentifier(id);
+	}
+	return id;
+}
 
-	regexInit();
-	logger("Initialized regex objects\n");
+sectionEntry& Assembler::section(uint32_t number) {
+	return sections[sectionIndex[number]];
 }
 
-Assembler::~Assembler() {
-	logFile.close();
-	asmFile.close();
-	objectFile.close();
+std::string Assembler::sectionName(uint32_t number) {
+	if (number == UNDEFINED_SECTION) {
+		return "UNDEFINED";
+	}
+	return std::string(names.name(section(number).name));
+}
 
-	for (auto i = 0; i < numberOfRegex; i++) {
-		delete allTheRegex[i].regex;
+void Assembler::returnErrorCode(int err, std::string message, std::string_view at) {
+	// column of at while it points into the line being parsed, else of the statement
+	auto column = 0;
+	if (readingLineNumber && !readLine.empty()) {
+		if (at.data() >= readLine.data() && at.data() < readLine.data() + readLine.size()) {
+			column = at.data() - readLine.data() + 1;
+		} else {
+			column = readLine.find_first_not_of(" \t") + 1;
+		}
+	}
+	if (readingLineNumber) {
+		logger.error(message, " at line ", readingLineNumber);
+	} else {
+		logger.error(message);
 	}
+	throw AssemblyError(err, readingLineNumber, message, column);
 }
 
-void Assembler::regexInit() {
-	for (auto i = 0; i < numberOfRegex; i++) {
-		allTheRegex[i].regex = new std::regex(regexes[i]);
+bool Assembler::recover(const AssemblyError& error) {
+	diagnostics.push_back( { error.line, error.column, error.code, error.message,
+			error.line ? sourceFiles[currentFile] : std::string() });
+	if (maxErrors != 0 && diagnostics.size() >= maxErrors) {
+		stopped = true;
 	}
+	return !stopped;
+}
 
-	/***
-	 * (1) *0xff(%r0), *0xff, 0xff
-	 * (2) *labela1(%r0), *labela2, labela3
-	 * (3) *%r0
-	 * (4) *%(r0)
-	 */
-	operandJumpRegex = std::regex(jumpRegex);
-	operandInstructionRegex = std::regex(instrOperandRegex);
+const std::vector<diagnostic>& Assembler::getDiagnostics() const {
+	return diagnostics;
 }
 
-void Assembler::logger(std::string s) {
-	logFile << s << std::endl;
+bool Assembler::printDiagnostics(std::ostream& out) const {
+	for (auto& error : diagnostics) {
+		out << formatDiagnostic(sourcePath, error) << '\n';
+	}
+	if (stopped) {
+		out << sourcePath << ": stopped after " << diagnostics.size() << " errors, see --max-errors" << '\n';
+	}
+	return !diagnostics.empty();
 }
 
-void Assembler::logger(std::string s, int i) {
-	logFile << s << i << std::endl;
+void Assembler::setMaxErrors(uint32_t limit) {
+	maxErrors = limit;
+}
+
+Logger& Assembler::getLogger() {
+	return logger;
+}
+
+Stats& Assembler::getStats() {
+	return stats;
+}
+
+SectionCache& Assembler::getCache() {
+	return cache;
+}
+
+SpillFile& Assembler::getSpill() {
+	return spill;
+}
+
+void Assembler::setIncludePaths(std::vector<std::string> paths) {
+	includePaths = paths;
+}
+
+void Assembler::setSourcePath(std::string path) {
+	sourcePath = path;
+}
+
+void Assembler::setOptimizeSize(bool on) {
+	optimizeSize = on;
+}
+
+void Assembler::collectStats(const assemblyResult& result) {
+	auto& counters = stats.counters;
+	counters.lookups = names.lookups();
+	counters.probes = names.probes();
+	counters.names = names.size();
+	counters.slots = names.capacity();
+	counters.literals = literals.size();
+	counters.sections = sections.size() - 1;
+	for (auto& table : result.relocations) {
+		counters.relocations += table.relocations.size();
+	}
+	for (auto& section : result.sections) {
+		counters.codeBytes += section.bytes.size();
+	}
+	// spilled sections have no bytes in the result
+	counters.codeBytes += counters.spilledBytes;
+}
+
+void Assembler::writeStats(bool success) {
+	if (statsPath == "-") {
+		stats.writeJson(std::cout, sourcePath, success);
+		return;
+	}
+	std::ofstream out(statsPath);
+	if (!out.good()) {
+		returnErrorCode(ERR_FOPEN, "Error while trying to create stats file");
+	}
+	stats.writeJson(out, sourcePath, success);
 }
 
 void Assembler::argumentsAnalyzer(int argc, std::vector<std::string> args) {
 	auto isNextObj = false;
+	auto isNextFormat = false;
+	auto isNextLevel = false;
+	auto isNextLog = false;
+	auto isNextStats = false;
+	auto isNextMaxErrors = false;
+	auto isNextCache = false;
+	auto isNextInclude = false;
+	auto isNextSpill = false;
+	auto hardwareStats = false;
+	std::string objectPath = "";
+	std::string logPath = "assemblyLog.txt";
+	auto logLevel = LOG_OFF;
+	objectFormat = OBJ_TEXT;
 	for (auto i = 0; i < argc; i++) {
 		if (isNextObj) {
-			objectFile.open(args[i], std::ios::out);
+			objectPath = args[i];
 			isNextObj = false;
-			if (!objectFile.good()) {
-				logger("Error while trying to create obj file");
-				returnErrorCode(ERR_FOPEN);
+		} else if (isNextLevel) {
+			if (!parseLogLevel(args[i], logLevel)) {
+				returnErrorCode(ERR_ARGUMENT, "Unknown log level " + args[i]);
+			}
+			isNextLevel = false;
+		} else if (isNextLog) {
+			logPath = args[i];
+			isNextLog = false;
+		} else if (isNextStats) {
+			statsPath = args[i];
+			isNextStats = false;
+		} else if (isNextMaxErrors) {
+			if (args[i].empty() || args[i].find_first_not_of("0123456789") != std::string::npos || args[i].size() > 9) {
+				returnErrorCode(ERR_ARGUMENT, "Invalid error limit " + args[i]);
 			}
+			maxErrors = std::stoul(args[i]);
+			isNextMaxErrors = false;
+		} else if (isNextCache) {
+			if (!cache.open(args[i])) {
+				returnErrorCode(ERR_FOPEN, "Error while trying to open cache directory");
+			}
+			isNextCache = false;
+		} else if (isNextInclude) {
+			includePaths.push_back(args[i]);
+			isNextInclude = false;
+		} else if (isNextSpill) {
+			if (!spill.open(args[i])) {
+				returnErrorCode(ERR_FOPEN, "Error while trying to create spill file");
+			}
+			isNextSpill = false;
+		} else if (isNextFormat) {
+			if (args[i] == "bin") {
+				objectFormat = OBJ_BIN;
+			} else if (args[i] != "text") {
+				returnErrorCode(ERR_ARGUMENT, "Unknown object format " + args[i]);
+			}
+			isNextFormat = false;
 		} else {
 			auto first = args[i][0];
 			switch (first) {
 			case '-':
 				if (args[i][1] == 'o') {
 					isNextObj = true;
+				} else if (args[i][1] == 'f') {
+					isNextFormat = true;
+				} else if (args[i][1] == 'l') {
+					isNextLevel = true;
+				} else if (args[i][1] == 'L') {
+					isNextLog = true;
+				} else if (args[i][1] == 'I') {
+					isNextInclude = true;
+				} else if (args[i] == "--stats" || args[i] == "--stats-hw") {
+					hardwareStats = args[i] == "--stats-hw";
+					isNextStats = true;
+				} else if (args[i] == "--max-errors") {
+					isNextMaxErrors = true;
+				} else if (args[i] == "--cache") {
+					isNextCache = true;
+				} else if (args[i] == "--spill") {
+					isNextSpill = true;
+				} else if (args[i] == "-Os") {
+					optimizeSize = true;
 				} else {
-					logger("Invalid argument after - ");
-					returnErrorCode(ERR_ARGUMENT);
+					returnErrorCode(ERR_ARGUMENT, "Invalid argument after - ");
 				}
 				break;
 			default:
-				asmFile.open(args[i], std::ios::in);
-				if (!asmFile.good()) {
-					logger("Error while trying to open src file");
-					returnErrorCode(ERR_FOPEN);
+				if (!asmFile.open(args[i])) {
+					returnErrorCode(ERR_FOPEN, "Error while trying to open src file");
 				}
+				sourcePath = args[i];
 				break;
 			}
 		}
 	}
+	if (statsPath != "") {
+		stats.enable(hardwareStats);
+	}
+	// only an enabled log touches the log file
+	logger.setLevel(logLevel);
+	if (logLevel != LOG_OFF) {
+		if (logPath == "-") {
+			logger.useStderr();
+		} else if (!logger.openFile(logPath)) {
+			returnErrorCode(ERR_FOPEN, "Error while trying to open log file");
+		}
+	}
+	if (objectPath != "") {
+		objectFile.open(objectPath, (objectFormat == OBJ_BIN) ? std::ios::out | std::ios::binary : std::ios::out);
+		if (!objectFile.good()) {
+			returnErrorCode(ERR_FOPEN, "Error while trying to create obj file");
+		}
+	}
 }
 
-bool compareSymbolTypes(std::pair<std::string, symbolTableEntry> a, std::pair<std::string, symbolTableEntry> b) {
-	if(a.second.symbolType == "section" && b.second.symbolType == "section") {
-		return true;
+void Assembler::generateObj() {
+	auto result = assemble(asmFile.text());
+	if (!result.success) {
+		if (stats.enabled()) {
+			writeStats(false);
+		}
+		auto& error = result.diagnostics.front();
+		throw AssemblyError(error.code, error.line, error.message);
 	}
-	if(a.second.symbolType == "section" && b.second.symbolType == "label") {
-		return true;
+	stats.begin(PHASE_OUTPUT);
+	if (spill.isOpen()) {
+		// the result has no section bytes, they are read back one section at a time
+		sectionSource source { [this, &result](size_t index) -> size_t {
+			auto& entry = section(result.sections[index].number);
+			return entry.spilled ? entry.spillSize : entry.code.dataSize();
+		}, [this, &result](size_t index, std::vector<uint8_t>& bytes) {
+			auto& entry = section(result.sections[index].number);
+			if (!entry.spilled) {
+				bytes = entry.code.bytes();
+				return true;
+			}
+			bytes.resize(entry.spillSize);
+			return spill.read(entry.spillOffset, bytes.data(), bytes.size());
+		} };
+		auto written = (objectFormat == OBJ_BIN) ? ObjectFormat::writeBinary(result, objectFile, source)
+				: ObjectFormat::writeText(result, objectFile, source);
+		if (!written) {
+			returnErrorCode(ERR_FOPEN, "Error while reading the spill file");
+		}
+	} else if (objectFormat == OBJ_BIN) {
+		ObjectFormat::writeBinary(result, objectFile);
+	} else {
+		ObjectFormat::writeText(result, objectFile);
 	}
-	if(a.second.symbolType == "label" && b.second.symbolType == "section") {
-		return false;
+	objectFile.flush();
+	stats.end(PHASE_OUTPUT);
+	if (stats.enabled()) {
+		stats.counters.objectBytes = std::max<std::streamoff>(0, objectFile.tellp());
+		writeStats(true);
 	}
+}
 
-	return true;
+assemblyResult Assembler::assemble(std::string_view source) {
+	assemblyResult result;
+	reset();
+	relaxStates.clear();
+	pass(source, result);
+	uint64_t passes = 1;
+	// -Os: again with the sizes the last pass settled, the counters are the ones of the final pass
+	while (optimizeSize && result.success && relaxOperands()) {
+		stats.clearCounters();
+		resetPass();
+		result = assemblyResult();
+		pass(source, result);
+		passes++;
+	}
+	if (optimizeSize) {
+		stats.counters.relaxPasses = passes;
+	}
+	return result;
 }
 
-bool compareUINT8_T(std::pair<std::string, symbolTableEntry> a, std::pair<std::string, symbolTableEntry> b) {
-	if(a.second.number <= b.second.number) {
-		return true;
+void Assembler::pass(std::string_view source, assemblyResult& result) {
+	result.success = false;
+	result.truncated = false;
+	stats.counters.sourceBytes = source.size();
+	try {
+		stats.begin(PHASE_PARSE);
+		parse(source);
+		stats.end(PHASE_PARSE);
+		stats.begin(PHASE_LITERALS);
+		resolveLiterals();
+		stats.end(PHASE_LITERALS);
+		stats.begin(PHASE_BACKPATCH);
+		backpatch();
+		stats.end(PHASE_BACKPATCH);
+		stats.begin(PHASE_RESULT);
+		buildResult(result);
+		stats.end(PHASE_RESULT);
+	} catch (AssemblyError& error) {
+		recover(error);
 	}
-	return false;
+	result.success = diagnostics.empty();
+	result.diagnostics = diagnostics;
+	result.truncated = stopped;
+	collectStats(result);
 }
 
-bool compareRelocationOffsets(relocationEntry a, relocationEntry b) {
-	if(a.offset <= b.offset) {
-		return true;
+void Assembler::parse(std::string_view source) {
+	size_t position = 0;
+	while (position < source.size() && !stopped) {
+		if (recording && position == recordEnd) {
+			storeSection();
+		}
+		auto end = source.find('\n', position);
+		if (end == std::string_view::npos) {
+			end = source.size();
+		}
+		readLine = source.substr(position, end - position);
+		position = end + 1;
+		++readingLineNumber;
+		stats.counters.lines++;
+		logger.trace(readingLineNumber, ": ", readLine);
+		try {
+			if (defining == BLOCK_NONE || !blockBody()) {
+				validateRegex(readLine);
+				if (matches.type == regexSection && !foundEnd && cache.isOpen() && !optimizeSize) {
+					position = sectionBody(source, position);
+				}
+			}
+		} catch (AssemblyError& error) {
+			// the rest of the line is dropped, parsing goes on with the next one
+			expansionDepth = 0;
+			if (!recover(error)) {
+				break;
+			}
+		}
+		if (foundEnd == true)
+			break;
+	}
+	if (defining != BLOCK_NONE && !stopped) {
+		recover(AssemblyError(ERR_SYNTAX, blockLine, (defining == BLOCK_MACRO) ? "Missing .endm" : "Missing .endr", 1));
+		defining = BLOCK_NONE;
 	}
-	return false;
+	if (recording && !stopped) {
+		storeSection();
+	}
+	recording = false;
+	// the last section, unless .end moved it already
+	if (spill.isOpen() && currentSectionIndex != 0 && !sections[currentSectionIndex].spilled) {
+		spillSection();
+	}
+
+	logger.info("Finished parsing file, ", readingLineNumber, " lines");
+	// errors found after parsing belong to the line that made the reference, if any
+	readingLineNumber = 0;
+	readLine = std::string_view();
 }
 
-bool compareValues(std::pair<std::string, literalEntry> a, std::pair<std::string, literalEntry> b) {
-	if(a.second.value <= b.second.value) {
-		return true;
+// called after a section line, returns where parsing goes on
+size_t Assembler::sectionBody(std::string_view source, size_t position) {
+	lineMatch probe;
+	auto end = position;
+	uint32_t lines = 0;
+	auto includes = false;
+	while (end < source.size()) {
+		auto next = source.find('\n', end);
+		next = (next == std::string_view::npos) ? source.size() : next + 1;
+		// section lines start in the first column, so does .include
+		if (source[end] == '.' && Lexer::classify(source.substr(end, next - end - (source[next - 1] == '\n')), probe)) {
+			if (probe.type == regexSection) {
+				break;
+			}
+			includes |= probe.type == regexInclude;
+		}
+		end = next;
+		lines++;
+	}
+	// the text of a body with includes doesn't say what it encodes to
+	if (lines == 0 || includes) {
+		return position;
+	}
+	auto text = source.substr(position, end - position);
+	if (cache.load(text, cacheEntry) && replaySection(cacheEntry)) {
+		logger.info("Section ", sectionName(currentSectionSymbolNumber), " lines ", readingLineNumber + 1, "-",
+				readingLineNumber + lines, " taken from cache");
+		readingLineNumber += lines;
+		stats.counters.lines += lines;
+		for (uint8_t type = 0; type < numberOfRegex; type++) {
+			stats.counters.lineTypes[type] += cacheEntry.lineTypes[type];
+		}
+		stats.counters.cachedSections++;
+		return end;
 	}
-	return false;
+
+	cacheEntry.text = std::string(text);
+	cacheEntry.sectionNumber = currentSectionSymbolNumber;
+	cacheEntry.flags = sections[currentSectionIndex].flags;
+	cacheEntry.symbolsBefore = symbolNumber;
+	cacheEntry.macros = macroHash;
+	cacheEntry.expansionsBefore = expansions;
+	cacheEntry.lines = lines;
+	cacheEntry.names.clear();
+	recordIds.clear();
+	recordBackpatch.clear();
+	recordGeneration++;
+	recordEnd = end;
+	recordLine = readingLineNumber;
+	recordErrors = diagnostics.size();
+	memcpy(recordLineTypes, stats.counters.lineTypes, sizeof(recordLineTypes));
+	recording = true;
+	return position;
 }
 
-template<typename T>
-void Assembler::printElement(T t){
-    objectFile << std::right << std::setw(20) << std::setfill(' ') << t;
+void Assembler::recordIdentifier(uint32_t id) {
+	if (id >= recordStamp.size()) {
+		recordStamp.resize(identifiers.size(), 0);
+	}
+	recordStamp[id] = recordGeneration;
+	auto& identifier = identifiers[id];
+	recordIds.push_back(id);
+	recordBackpatch.push_back(identifier.backpatch.size());
+	cacheEntry.names.push_back( { std::string(names.name(id)), identifier.kind, ID_NONE, identifier.symbol, { } });
 }
 
-void Assembler::generateObj() {
-	readLine = "";
-	while (std::getline(asmFile, readLine)) {
-		++readingLineNumber;
-		validateRegex();
-		if (foundEnd == true)
-			break;
+static bool sameSymbol(const symbolTableEntry& a, const symbolTableEntry& b) {
+	return a.number == b.number && a.sectionNumber == b.sectionNumber && a.offset == b.offset && a.type == b.type
+			&& a.size == b.size && a.symbolType == b.symbolType;
+}
+
+// false, and nothing changed, unless the body saw the same identifiers the last time
+bool Assembler::replaySection(const cachedSection& entry) {
+	if (entry.sectionNumber != currentSectionSymbolNumber || entry.flags != sections[currentSectionIndex].flags
+			|| entry.symbolsBefore != symbolNumber || entry.macros != macroHash || entry.expansionsBefore != expansions) {
+		return false;
+	}
+	for (auto& name : entry.names) {
+		auto id = names.find(name.name);
+		auto kind = (id == Interner::NOT_FOUND) ? ID_NONE : identifiers[id].kind;
+		if (kind != name.kindBefore || (kind == ID_SYMBOL && !sameSymbol(identifiers[id].symbol, name.before))) {
+			return false;
+		}
 	}
 
-	logger("Finished parsing file");
-	// prvo izracunaj sve izraze u literalima
-	for(auto iter = literalTable.begin() ; iter != literalTable.end(); ++iter) {
-		auto literal = iter->first;
-		calculateLiteral(literal);
+	recordIds.clear();
+	for (auto& name : entry.names) {
+		auto id = identify(name.name);
+		recordIds.push_back(id);
+		if (name.kindAfter == ID_SYMBOL) {
+			identifiers[id].kind = ID_SYMBOL;
+			identifiers[id].symbol = name.after;
+		}
+	}
+	symbolNumber = entry.symbolsAfter;
+	expansions = entry.expansionsAfter;
+	for (auto& backpatch : entry.backpatch) {
+		if (backpatch.relocationType == LITERAL) {
+			stats.counters.literalBackpatches++;
+		} else {
+			stats.counters.forwardReferences++;
+		}
+		addBackpatch(recordIds[backpatch.name], { currentSectionSymbolNumber, backpatch.offset, backpatch.action,
+				backpatch.size, backpatch.relocationType, readingLineNumber + backpatch.line, currentFile });
+	}
+	auto& relocations = sections[currentSectionIndex].relocations;
+	relocations.insert(relocations.end(), entry.relocations.begin(), entry.relocations.end());
+	// runs count the runs before them, the bytes between runs go first
+	size_t stored = 0, filled = 0;
+	for (auto& run : entry.fills) {
+		auto data = run.offset - filled;
+		code->append(entry.bytes.data() + stored, data - stored);
+		code->fill(run.value, run.count);
+		stored = data;
+		filled += run.count;
 	}
+	code->append(entry.bytes.data() + stored, entry.bytes.size() - stored);
+	locationCounter = entry.size;
+	return true;
+}
+
+// the body ended, stored unless it had errors
+void Assembler::storeSection() {
+	recording = false;
+	stats.counters.encodedSections++;
+	// a block still open at the end isn't complete
+	if (diagnostics.size() != recordErrors || defining != BLOCK_NONE) {
+		return;
+	}
+	for (size_t i = 0; i < recordIds.size(); i++) {
+		auto& identifier = identifiers[recordIds[i]];
+		auto& name = cacheEntry.names[i];
+		name.kindAfter = identifier.kind;
+		name.after = identifier.symbol;
+	}
+	cacheEntry.backpatch.clear();
+	for (size_t i = 0; i < recordIds.size(); i++) {
+		// a label defined in the body applied and released its entries, the ones before the body included
+		auto& backpatch = identifiers[recordIds[i]].backpatch;
+		auto before = std::min(recordBackpatch[i], backpatch.size());
+		for (auto entry = backpatch.begin() + before; entry != backpatch.end(); ++entry) {
+			cacheEntry.backpatch.push_back( { (uint32_t)i, entry->line - recordLine, entry->offset, entry->action, entry->size,
+					entry->relocationType });
+		}
+	}
+	for (uint8_t type = 0; type < numberOfRegex; type++) {
+		cacheEntry.lineTypes[type] = stats.counters.lineTypes[type] - recordLineTypes[type];
+	}
+	cacheEntry.symbolsAfter = symbolNumber;
+	cacheEntry.expansionsAfter = expansions;
+	cacheEntry.size = locationCounter;
+	cacheEntry.relocations = sections[currentSectionIndex].relocations;
+	cacheEntry.bytes = code->bytes();
+	cacheEntry.fills = code->fills();
+	cache.store(cacheEntry);
+}
+
+void Assembler::resolveLiterals() {
+	// prvo izracunaj sve izraze u literalima, svaki posle literala koje koristi
+	for (uint32_t literal = 0; literal < literals.size() && !stopped; literal++) {
+		resolveLiteral(literal);
+	}
+	readingLineNumber = 0;
+	currentFile = 0;
+
+	logger.info("Calculated literal symbols");
+}
+
+// depth first over the literals root refers to, without recursion so long chains can't exhaust the stack
+void Assembler::resolveLiteral(uint32_t root) {
+	literalStack.assign(1, root);
+	while (!literalStack.empty() && !stopped) {
+		auto literal = literalStack.back();
+		auto& compiled = compiledLiterals[literal];
+		if (compiled.state == LITERAL_DONE) {
+			literalStack.pop_back();
+			continue;
+		}
+		compiled.state = LITERAL_ACTIVE;
+		readingLineNumber = literals[literal].line;
+		currentFile = literals[literal].file;
+
+		auto waiting = false;
+		for (auto token = compiled.start; token < compiled.start + compiled.length; token++) {
+			auto symbol = expressionCode[token].value;
+			if (expressionCode[token].kind != EXPR_SYMBOL || !checkSymbolIsLiteral(symbol)) {
+				continue;
+			}
+			auto& dependency = compiledLiterals[identifiers[symbol].literal];
+			if (dependency.state == LITERAL_ACTIVE) {
+				// the literals on the stack are left at 0, the error is reported once
+				for (auto active : literalStack) {
+					compiledLiterals[active].state = LITERAL_DONE;
+				}
+				literalStack.clear();
+				recover(AssemblyError(ERR_SYNTAX, readingLineNumber, "Circular equ definition of "
+						+ std::string(names.name(compiled.name)) + " through " + std::string(names.name(symbol))));
+				return;
+			}
+			if (dependency.state == LITERAL_PENDING) {
+				literalStack.push_back(identifiers[symbol].literal);
+				waiting = true;
+				break;
+			}
+		}
+		if (waiting) {
+			continue;
+		}
+		literalStack.pop_back();
+		compiled.state = LITERAL_DONE;
+		try {
+			evaluateLiteral(literal);
+		} catch (AssemblyError& error) {
+			recover(error);
+		}
+	}
+}
 
-	logger("Calculated literal symbols");
+void Assembler::backpatch() {
 	// onda backpatching koda i potrebne relokacije
-	for(auto iter = TII.begin(); iter != TII.end(); iter++) {
-		auto symbol = iter->first;
-		for(auto entry : iter->second) {
-			auto operation = entry.action;
-			auto offset = entry.offset;
-			auto section = entry.sectionNumber;
-			auto& vect = machineCode[section];
-			if(checkSymbolIsLiteral(symbol)) {
-				auto& literal = literalTable[symbol];
-				if(entry.size == 1) {
-					if(literal.relocations.size() != 0 || literal.value < -128 || literal.value > 127) {
-						std::stringstream log;
-						log << "2B literal used in 1B backpatch section " << section << " offset " << offset;
-						logger(log.str());
-						returnErrorCode(ERR_INVALID_OPERAND);
-					}
-					vect[offset] += (operation == ADD) ? literal.value : 0 - literal.value;
+	for(uint32_t symbol = 0; symbol < identifiers.size() && !stopped; symbol++) {
+		for(auto& entry : identifiers[symbol].backpatch) {
+			if (stopped) {
+				break;
+			}
+			readingLineNumber = entry.line;
+			currentFile = entry.file;
+			try {
+				backpatchEntry(symbol, entry);
+			} catch (AssemblyError& error) {
+				recover(error);
+			}
+		}
+	}
+	readingLineNumber = 0;
+	currentFile = 0;
+	if (spill.isOpen() && !stopped && !spill.applyPatches()) {
+		returnErrorCode(ERR_FOPEN, "Error while patching the spill file");
+	}
+
+	logger.info("Done backpatching");
+}
+
+void Assembler::backpatchEntry(uint32_t symbol, const backpatchInfo& entry) {
+	auto operation = entry.action;
+	auto offset = entry.offset;
+	auto section = entry.sectionNumber;
+	auto& target = this->section(section);
+	if(checkSymbolIsLiteral(symbol)) {
+		auto& literal = literals[identifiers[symbol].literal];
+		if(entry.size == 1) {
+			if(literal.relocations.size() != 0 || literal.value < -128 || literal.value > 127) {
+				std::stringstream log;
+				log << "2B literal " << names.name(symbol) << " used in 1B backpatch section " << section << " offset " << offset;
+				returnErrorCode(ERR_INVALID_OPERAND, log.str());
+			}
+			patchCode(target, offset, (operation == ADD) ? literal.value : 0 - literal.value, 1);
+		} else {
+			patchCode(target, offset, (operation == ADD) ? literal.value : 0 - literal.value, 2);
+			for(auto reloc : literal.relocations) {
+				target.relocations.push_back({offset, reloc.type, reloc.op, reloc.symbolNumber});
+			}
+		}
+	} else {
+		if(checkSymbolExists(symbol)) {
+			auto& sym = identifiers[symbol].symbol;
+			if(checkSymbolIsExtern(symbol) || checkSymbolIsGlobal(symbol)) {
+				if(checkSymbolIsGlobal(symbol) && entry.relocationType == R_PC16 && section == sym.sectionNumber) {
+					patchCode(target, offset, sym.offset - offset, 2);
 				} else {
-					ImmedValues immed;
-					immed.byte1 = vect[offset];
-					immed.byte2 = vect[offset+1];
-					immed.val += (operation == ADD) ? literal.value : 0 - literal.value;
-					vect[offset] = immed.byte1;
-					vect[offset+1] = immed.byte2;
-					for(auto reloc : literal.relocations) {
-						relocationTable[sectionTranslation[section]].push_back({offset, reloc.type, reloc.op, reloc.symbolNumber});
-					}
+					target.relocations.push_back({offset, entry.relocationType, operation, sym.number});
 				}
 			} else {
-				if(checkSymbolExists(symbol)) {
-					auto& sym = symbolTable[symbol];
-					if(checkSymbolIsExtern(symbol) || checkSymbolIsGlobal(symbol)) {
-						if(checkSymbolIsGlobal(symbol) && entry.relocationType == R_PC16 && section == sym.sectionNumber) {
-							ImmedValues immed;
-							immed.byte1 = vect[offset];
-							immed.byte2 = vect[offset+1];
-							immed.val += sym.offset - offset;
-							vect[offset] = immed.byte1;
-							vect[offset+1] = immed.byte2;
-						} else {
-							relocationTable[sectionTranslation[section]].push_back({offset, entry.relocationType, operation, sym.number});
-						}
+				if(checkSymbolIsDefined(symbol)) {
+					if(entry.relocationType != R_PC16 || section != sym.sectionNumber) {
+						patchCode(target, offset, (operation == ADD) ? sym.offset : 0 - sym.offset, 2);
+						target.relocations.push_back({offset, entry.relocationType, operation, sym.sectionNumber});
 					} else {
-						if(checkSymbolIsDefined(symbol)) {
-							ImmedValues immed;
-							immed.byte1 = vect[offset];
-							immed.byte2 = vect[offset+1];
-							if(entry.relocationType != R_PC16 || section != sym.sectionNumber) {
-								immed.val += (operation == ADD) ? sym.offset : 0 - sym.offset;
-								relocationTable[sectionTranslation[section]].push_back({offset, entry.relocationType, operation, sym.sectionNumber});
-							} else {
-								immed.val += sym.offset - offset;
-							}
-							vect[offset] = immed.byte1;
-							vect[offset+1] = immed.byte2;
-						} else {
-							std::stringstream log;
-							log << "Symbol doesn't exist, backpatching failed at section " << entry.sectionNumber << " offset " << entry.offset;
-							logger(log.str());
-							returnErrorCode(ERR_UNDEFINED_SYMBOL);
-						}
+						patchCode(target, offset, sym.offset - offset, 2);
 					}
 				} else {
 					std::stringstream log;
-					log << "Symbol doesn't exist, backpatching failed at section " << entry.sectionNumber << " offset " << entry.offset;
-					logger(log.str());
-					returnErrorCode(ERR_UNDEFINED_SYMBOL);
+					log << "Symbol " << names.name(symbol) << " doesn't exist, backpatching failed at section " << entry.sectionNumber << " offset " << entry.offset;
+					returnErrorCode(ERR_UNDEFINED_SYMBOL, log.str());
 				}
 			}
+		} else {
+			std::stringstream log;
+			log << "Symbol " << names.name(symbol) << " doesn't exist, backpatching failed at section " << entry.sectionNumber << " offset " << entry.offset;
+			returnErrorCode(ERR_UNDEFINED_SYMBOL, log.str());
 		}
 	}
 
-	logger("Done backpatching");
-	// tabela simbola
-	std::vector<std::pair<std::string, symbolTableEntry>> symbols(symbolTable.begin(), symbolTable.end());
-	std::sort(symbols.begin(), symbols.end(), compareSymbolTypes);
-	objectFile << "%SYMBOL TABLE%" << std::endl;
-	printElement("Symbol");
-	printElement("Symbol number");
-	printElement("Section");
-	printElement("Offset");
-	printElement("Type");
-	printElement("Size");
-	printElement("SymbolType");
-	objectFile << std::endl;
-	for(auto symbol : symbols) {
-		if(symbol.second.sectionNumber == UNDEFINED_SECTION && symbol.second.type != "extern") {
-			logger("Undefined non-extern symbol");
-			returnErrorCode(ERR_SYNTAX);
-		}
-		printElement(symbol.first);
-		printElement((int)symbol.second.number);
-		printElement(sectionTranslation[symbol.second.sectionNumber]);
-		printElement(symbol.second.offset);
-		printElement(symbol.second.type);
-		printElement((int)symbol.second.size);
-		printElement(symbol.second.symbolType);
-		objectFile << std::endl;
-	}
-	objectFile << std::endl;
-
-	// tabela equ literala
-	objectFile << "%EQU SYMBOLS%" << std::endl;
-	printElement("Symbol");
-	printElement("Value");
-	printElement("Relocations");
-	objectFile << std::endl;
-	std::vector<std::pair<std::string, literalEntry>> literals(literalTable.begin(), literalTable.end());
-	std::sort(literals.begin(), literals.end(), compareValues);
-	for(auto literal : literals) {
-		printElement(literal.first);
-		printElement((int)literal.second.value);
-		std::stringstream ss;
-		for(auto relocs : literal.second.relocations) {
-			ss << relocs.op;
-			ss << (int)relocs.symbolNumber;
-			ss << ' ';
-		}
-		printElement(ss.str());
-		objectFile << std::endl;
-	}
-
-	objectFile << std::endl;
-
-	// tabele relokacija po sekciji
-	for(auto it : relocationTable) {
-		printElement("%RELOCATION TABLE% - section ");
-		printElement(it.first);
-		objectFile << std::endl;
-		printElement("Symbol number");
-		printElement("Offset");
-		printElement("Operation");
-		printElement("Relocation type");
-		objectFile << std::endl;
-		std::sort(it.second.begin(), it.second.end(), compareRelocationOffsets);
-		for(auto reloc : it.second) {
-			printElement((int)reloc.value);
-			printElement(reloc.offset);
-			printElement(reloc.op);
-			printElement(reloc.type);
-			objectFile << std::endl;
-		}
-	objectFile << std::endl;
-	}
-	objectFile << std::endl;
-
-	// masinski kod po sekcijama
-	for (auto it : sectionTable) {
-		if(it.first == "UNDEFINED") {
-			continue;
+}
+
+// adds value to the size bytes at offset, little endian, bytes in the spill file are patched after the pass
+void Assembler::patchCode(sectionEntry& target, uint16_t offset, int32_t value, uint8_t size) {
+	auto& vect = target.code;
+	if (!target.spilled) {
+		if (size == 1) {
+			vect[offset] += value;
+			return;
+		}
+		uint16_t word = vect[offset] | (vect[offset+1] << 8);
+		word += value;
+		vect[offset] = word & 0xff;
+		vect[offset+1] = word >> 8;
+		return;
+	}
+	// the bytes operator[] reaches, the ones in a run or past the stored bytes aren't in the object
+	auto stored = [&target](size_t data) {
+		return data != SectionBuffer::IN_RUN && data < target.spillSize;
+	};
+	auto low = vect.dataOffset(offset);
+	auto high = (size == 2) ? vect.dataOffset(offset + 1) : SectionBuffer::IN_RUN;
+	stats.counters.spillPatches++;
+	if (stored(low) && stored(high) && high == low + 1) {
+		spill.patch(target.spillOffset + low, value, 2);
+	} else if (stored(low)) {
+		spill.patch(target.spillOffset + low, value, 1);
+	} else if (stored(high)) {
+		spill.patch(target.spillOffset + high, value >> 8, 1);
+	}
+}
+
+// the current section is finished, its stored bytes move to the spill file
+void Assembler::spillSection() {
+	auto& target = sections[currentSectionIndex];
+	auto bytes = target.code.bytes();
+	if (!spill.append(bytes, target.spillOffset)) {
+		returnErrorCode(ERR_FOPEN, "Error while writing the spill file");
+	}
+	target.spillSize = bytes.size();
+	target.spilled = true;
+	target.code.release();
+	stats.counters.spilledSections++;
+	stats.counters.spilledBytes += bytes.size();
+}
+
+// stable LSD radix sort on the 16 bit offset, two passes over 256 buckets, a table already in order costs one scan
+static void sortByOffset(std::vector<relocationEntry>& relocations, std::vector<relocationEntry>& scratch) {
+	auto ordered = std::is_sorted(relocations.begin(), relocations.end(), [](const relocationEntry& a, const relocationEntry& b) {
+		return a.offset < b.offset;
+	});
+	if (ordered) {
+		return;
+	}
+	scratch.resize(relocations.size());
+	for (unsigned shift = 0; shift < 16; shift += 8) {
+		size_t start[257] = { };
+		for (auto& relocation : relocations) {
+			start[((relocation.offset >> shift) & 0xff) + 1]++;
+		}
+		for (size_t digit = 1; digit < 257; digit++) {
+			start[digit] += start[digit - 1];
 		}
-		objectFile <<std::dec<< "." <<it.first<<"\t"<<(int)it.second.sectionSize<<std::endl;
-		auto breaker = 0;
-		for(auto i : machineCode[it.second.number]) {
-			objectFile<<std::setfill('0')<<std::hex<<std::setw(2)<<(unsigned)i<<" ";
-			++breaker;
-			if(breaker%16 == 0){
-				objectFile << std::endl;
+		for (auto& relocation : relocations) {
+			scratch[start[(relocation.offset >> shift) & 0xff]++] = relocation;
+		}
+		relocations.swap(scratch);
+	}
+}
+
+void Assembler::buildResult(assemblyResult& result) {
+	// tabela simbola, sekcije pa labele po rednom broju
+	std::vector<uint32_t> symbols;
+	for(uint32_t id = 0; id < identifiers.size(); id++) {
+		if(checkSymbolExists(id)) {
+			symbols.push_back(id);
+		}
+	}
+	std::sort(symbols.begin(), symbols.end(), [this](uint32_t a, uint32_t b) {
+		auto& first = identifiers[a].symbol;
+		auto& second = identifiers[b].symbol;
+		if(first.symbolType != second.symbolType) {
+			return first.symbolType == SYM_SECTION;
+		}
+		return first.number < second.number;
+	});
+	for(auto id : symbols) {
+		auto& symbol = identifiers[id].symbol;
+		if(symbol.sectionNumber == UNDEFINED_SECTION && symbol.type != SYM_EXTERN) {
+			try {
+				returnErrorCode(ERR_SYNTAX, "Undefined non-extern symbol " + std::string(names.name(id)));
+			} catch (AssemblyError& error) {
+				if (!recover(error)) {
+					return;
+				}
 			}
+			continue;
 		}
-		objectFile << std::endl;
-		objectFile << std::endl;
+		result.symbols.push_back( { std::string(names.name(id)), sectionName(symbol.sectionNumber), symbol });
 	}
 
+	// tabela equ literala, po vrednosti
+	std::vector<uint32_t> equ;
+	for(uint32_t id = 0; id < identifiers.size(); id++) {
+		if(checkSymbolIsLiteral(id)) {
+			equ.push_back(id);
+		}
+	}
+	std::sort(equ.begin(), equ.end(), [this](uint32_t a, uint32_t b) {
+		auto first = literals[identifiers[a].literal].value;
+		auto second = literals[identifiers[b].literal].value;
+		return (first != second) ? first < second : names.name(a) < names.name(b);
+	});
+	for(auto id : equ) {
+		result.literals.push_back( { std::string(names.name(id)), literals[identifiers[id].literal] });
+	}
+
+	// tabele relokacija i masinski kod po sekcijama, po rednom broju
+	std::vector<uint32_t> order;
+	for(uint32_t index = 1; index < sections.size(); index++) {
+		order.push_back(index);
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return sections[a].number < sections[b].number;
+	});
+	for(auto index : order) {
+		auto& section = sections[index];
+		if(section.relocations.empty()) {
+			continue;
+		}
+		sortByOffset(section.relocations, relocationScratch);
+		result.relocations.push_back( { sectionName(section.number), std::move(section.relocations) });
+	}
+	for(auto index : order) {
+		auto& section = sections[index];
+		if (section.flags & SECTION_NOBITS) {
+			result.sections.push_back( { sectionName(section.number), section.number, section.sectionSize, { }, { }, section.flags });
+		} else {
+			result.sections.push_back( { sectionName(section.number), section.number, section.sectionSize, section.code.bytes(),
+					section.code.fills(), section.flags });
+		}
+	}
 }
 
-std::string Assembler::get(uint8_t i) {
-	return matches.str(i);
+std::string_view Assembler::get(uint8_t i) {
+	return matches.group[i];
 }
 
-bool Assembler::checkSymbolExists(std::string label) {
-	return (symbolTable.find(label) != symbolTable.end());
+bool Assembler::checkSymbolExists(uint32_t label) {
+	return identifiers[label].kind == ID_SYMBOL;
 }
-bool Assembler::checkSymbolIsLiteral(std::string symbol) {
-	return (literalTable.find(symbol) != literalTable.end());
+bool Assembler::checkSymbolIsLiteral(uint32_t symbol) {
+	return identifiers[symbol].kind == ID_LITERAL;
 }
 
-bool Assembler::checkSymbolIsExtern(std::string symbol) {
-	return symbolTable.at(symbol).type == "extern";
+bool Assembler::checkSymbolIsExtern(uint32_t symbol) {
+	return identifiers[symbol].symbol.type == SYM_EXTERN;
 }
 
-bool Assembler::checkSymbolIsGlobal(std::string symbol) {
-	return symbolTable.at(symbol).type == "global";
+bool Assembler::checkSymbolIsGlobal(uint32_t symbol) {
+	return identifiers[symbol].symbol.type == SYM_GLOBAL;
 }
 
-bool Assembler::checkSymbolIsDefined(std::string label) {
-	return symbolTable.at(label).sectionNumber;
+bool Assembler::checkSymbolIsDefined(uint32_t label) {
+	return identifiers[label].symbol.sectionNumber;
 }
 
-void Assembler::defineLabel(std::string label) {
-	auto& symbol = symbolTable[label];
+void Assembler::defineLabel(uint32_t label) {
+	auto& symbol = identifiers[label].symbol;
 	symbol.sectionNumber = currentSectionSymbolNumber;
 	symbol.offset = locationCounter;
 	symbol.size = 0;
-	if (symbol.type != "global") {
-		symbol.type = "local";
+	if (symbol.type != SYM_GLOBAL) {
+		symbol.type = SYM_LOCAL;
+	}
+	symbol.symbolType = SYM_LABEL;
+
+	// the address is final now, the references waiting for it are patched and their entries released
+	auto& pending = identifiers[label].backpatch;
+	if (pending.empty()) {
+		return;
+	}
+	for (auto& entry : pending) {
+		backpatchEntry(label, entry);
+	}
+	stats.counters.definitionBackpatches += pending.size();
+	openBackpatches -= pending.size();
+	std::vector<backpatchInfo>().swap(pending);
+}
+
+void Assembler::addBackpatch(uint32_t symbol, const backpatchInfo& entry) {
+	identifiers[symbol].backpatch.push_back(entry);
+	if (++openBackpatches > stats.counters.peakBackpatches) {
+		stats.counters.peakBackpatches = openBackpatches;
 	}
-	symbol.symbolType = "label";
 }
 
-void Assembler::addUndefinedSymbol(std::string symbol) {
+void Assembler::addSymbol(uint32_t id, symbolTableEntry entry) {
+	identifiers[id].kind = ID_SYMBOL;
+	identifiers[id].symbol = entry;
+}
+
+void Assembler::addUndefinedSymbol(uint32_t symbol) {
 	++symbolNumber;
-	symbolTable.insert( { symbol, { symbolNumber, UNDEFINED_SECTION, 0, "local",
-			0, "label" } });
+	addSymbol(symbol, { symbolNumber, UNDEFINED_SECTION, 0, SYM_LOCAL,
+			0, SYM_LABEL });
 }
 
-void Assembler::addNewLabel(std::string label) {
+void Assembler::addNewLabel(uint32_t label) {
 	++symbolNumber;
-	symbolTable.insert( { label, { symbolNumber, currentSectionSymbolNumber, locationCounter, "local", 0, "label" } });
+	addSymbol(label, { symbolNumber, currentSectionSymbolNumber, locationCounter, SYM_LOCAL, 0, SYM_LABEL });
+}
+
+// a run in the section buffer, the bytes aren't stored
+void Assembler::fill(uint8_t value, uint32_t count) {
+	if (locationCounter + count > UINT16_MAX) {
+		returnErrorCode(ERR_SECTION, "Section larger than 64KB");
+	}
+	code->fill(value, count);
+	locationCounter += count;
+}
+
+uint16_t Assembler::toCount(std::string_view number) {
+	return (uint16_t)toInt16_t(number);
 }
 
 void Assembler::checkSection() {
-	if (currentSection == "UNDEFINED") {
-		logger("Out of section code at line ",readingLineNumber);
-		returnErrorCode(ERR_SECTION);
+	if (currentSectionSymbolNumber == UNDEFINED_SECTION) {
+		returnErrorCode(ERR_SECTION, "Out of section code");
 	}
 }
 
-void Assembler::createRelocation(uint8_t symbol, std::string type, char operation) {
-	relocationTable[currentSection].push_back( { locationCounter, type, operation, symbol });
+void Assembler::createRelocation(uint32_t symbol, uint8_t type, char operation) {
+	sections[currentSectionIndex].relocations.push_back( { locationCounter, type, operation, symbol });
 }
 
-void Assembler::addGlobal(std::string expression) {
-	auto symbols = parserComma(expression);
-	for (auto symbol : symbols) {
+void Assembler::addGlobal(std::string_view expression) {
+	parserComma(expression, listItems);
+	for (auto item : listItems) {
+		auto symbol = identify(item);
 		if (checkSymbolIsLiteral(symbol)) {
-			logger("Symbol is literal, cannot be global, at line ",readingLineNumber);
-			returnErrorCode(ERR_REDEFINITION);
+			returnErrorCode(ERR_REDEFINITION, "Symbol is literal, cannot be global", item);
 		}
 		if (checkSymbolExists(symbol)) {
 			if(checkSymbolIsExtern(symbol)) {
-				logger("Symbol cannot be extern and global, at line ",readingLineNumber);
-				returnErrorCode(ERR_UNDEFINED_SYMBOL);
+				returnErrorCode(ERR_UNDEFINED_SYMBOL, "Symbol cannot be extern and global", item);
 			}
-			symbolTable[symbol].type = "global";
+			identifiers[symbol].symbol.type = SYM_GLOBAL;
 		} else {
 			++symbolNumber;
-			symbolTable.insert( { symbol, { symbolNumber, UNDEFINED_SECTION, 0,
-					"global", 0, "label" } });
+			addSymbol(symbol, { symbolNumber, UNDEFINED_SECTION, 0,
+					SYM_GLOBAL, 0, SYM_LABEL });
 		}
 	}
 }
 
-void Assembler::addExtern(std::string expression) {
-	auto symbols = parserComma(expression);
-	for (auto symbol : symbols) {
+void Assembler::addExtern(std::string_view expression) {
+	parserComma(expression, listItems);
+	for (auto item : listItems) {
+		auto symbol = identify(item);
 		if (checkSymbolIsLiteral(symbol)) {
-			logger(
-					"Symbol is literal, cannot be extern, at line ",readingLineNumber);
-			returnErrorCode(ERR_REDEFINITION);
+			returnErrorCode(ERR_REDEFINITION, "Symbol is literal, cannot be extern", item);
 		}
 		if (checkSymbolExists(symbol)) {
-			logger("Symbol declared extern already exists in symbol table, error in line ",readingLineNumber);
-			returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+			returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Symbol declared extern already exists in symbol table", item);
 		}
 		++symbolNumber;
-		symbolTable.insert( { symbol, { symbolNumber, UNDEFINED_SECTION, 0,
-				"extern", 0, "label" } });
+		addSymbol(symbol, { symbolNumber, UNDEFINED_SECTION, 0,
+				SYM_EXTERN, 0, SYM_LABEL });
 	}
 }
 
-void Assembler::resolveSymbol(std::string symbol) {
-	if (symbol == "") {
+void Assembler::resolveSymbol(std::string_view label) {
+	if (label.empty()) {
 		return;
 	}
+	auto symbol = identify(label);
 	if (checkSymbolIsLiteral(symbol)) {
-		logger("Multiple definitions of symbol at line ",readingLineNumber);
-		returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+		returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Multiple definitions of symbol", label);
 	}
 	if (checkSymbolExists(symbol)) {
 		if (checkSymbolIsDefined(symbol) || checkSymbolIsExtern(symbol)) {
-			logger("Multiple definitions or symbol is extern, symbol at line ",readingLineNumber);
-			returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+			returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Multiple definitions or symbol is extern", label);
 		} else {
 			defineLabel(symbol);
 		}
@@ -457,158 +1027,384 @@ void Assembler::resolveSymbol(std::string symbol) {
 	}
 }
 
-void Assembler::calculateExpression(std::string lit, char operation, std::string operand) {
-	auto& literal = literalTable[lit];
-	if (operand[0] >= '0' && operand[0] <= '9') {
-		 literal.value += (operation == ADD) ? toInt16_t(operand) : 0 - toInt16_t(operand);
-	} else {
-		if(checkSymbolIsLiteral(operand)) {
-			logger("Equ defined literal used in equ definition at line ",readingLineNumber);
-			returnErrorCode(ERR_SYNTAX);
+int32_t Assembler::termValue(uint32_t symbol, uint32_t literal, std::vector<relocationInfo>& relocations) {
+	if (checkSymbolIsLiteral(symbol)) {
+		auto& used = literals[identifiers[symbol].literal];
+		relocations.insert(relocations.end(), used.relocations.begin(), used.relocations.end());
+		return used.value;
+	}
+	if (checkSymbolExists(symbol)) {
+		auto& entry = identifiers[symbol].symbol;
+		if (checkSymbolIsExtern(symbol) || checkSymbolIsGlobal(symbol)) {
+			relocations.push_back( { entry.number, ADD, R_16 });
+			return 0;
 		}
-		if(checkSymbolExists(operand)) {
-			if(checkSymbolIsExtern(operand) || checkSymbolIsGlobal(operand)) {
-				literal.relocations.push_back({symbolTable[operand].number, operation, R_16});
-			} else {
-				if(checkSymbolIsDefined(operand)) {
-					literal.value += (operation == ADD) ? symbolTable[operand].offset : 0 - symbolTable[operand].offset;
-					literal.relocations.push_back({symbolTable[operand].sectionNumber, operation, R_16});
-				} else {
-					logger("Error, symbol undefined in equ definition for " + lit);
-					returnErrorCode(ERR_UNDEFINED_SYMBOL);
-				}
-			}
-		} else {
-		logger("Error, symbol undefined in equ definition for " + lit);
-		returnErrorCode(ERR_UNDEFINED_SYMBOL);
+		if (checkSymbolIsDefined(symbol)) {
+			relocations.push_back( { entry.sectionNumber, ADD, R_16 });
+			return entry.offset;
 		}
 	}
+	returnErrorCode(ERR_UNDEFINED_SYMBOL, "Error, symbol undefined in equ definition for "
+			+ std::string(names.name(compiledLiterals[literal].name)));
+	return 0;
 }
 
-
-void Assembler::calculateLiteral(std::string literal) {
-	auto& literalEntry = literalTable[literal];
-	auto expression = literalEntry.expression;
-	expression.erase(std::remove(expression.begin(), expression.end(),' '), expression.end());
-	char operation = ADD;
-	while(expression.length()) {
-		if(expression[0] == '+' || expression[0] == '-') {
-			operation = expression[0];
-			expression.erase(0,1);
+/*
+ * One pass over the RPN. The relocations of the terms on the stack follow each other in the order of the terms,
+ * a stack entry owns those from its first one to the first one of the entry above it.
+ * Only + and - take relocatable operands.
+ */
+void Assembler::evaluateLiteral(uint32_t literal) {
+	auto& compiled = compiledLiterals[literal];
+	auto& entry = literals[literal];
+	auto& relocations = entry.relocations;
+	relocations.clear();
+	evaluationStack.clear();
+	auto negate = [&relocations](uint32_t first) {
+		for (auto i = first; i < relocations.size(); i++) {
+			relocations[i].op = (relocations[i].op == ADD) ? SUB : ADD;
 		}
-		auto positionPlus = expression.find_first_of("+");
-		auto positionMinus = expression.find_first_of("-");
-		if(positionPlus == std::string::npos) {
-			if(positionMinus == std::string::npos) {
-				calculateExpression(literal, operation, expression);
-				break;
-			} else {
-				auto operand = expression.substr(0, positionMinus);
-				calculateExpression(literal, operation, operand);
-				expression.erase(0, positionMinus);
+	};
+	auto name = [this, &compiled]() {
+		return std::string(names.name(compiled.name));
+	};
+	for (auto token = compiled.start; token < compiled.start + compiled.length; token++) {
+		auto& operation = expressionCode[token];
+		if (operation.kind == EXPR_NUMBER || operation.kind == EXPR_SYMBOL) {
+			uint32_t first = relocations.size();
+			auto value = (operation.kind == EXPR_NUMBER) ? operation.value : termValue(operation.value, literal, relocations);
+			evaluationStack.push_back( { value, first });
+			continue;
+		}
+		if (operation.kind == EXPR_NEGATE) {
+			evaluationStack.back().first = (int32_t)(0u - (uint32_t)evaluationStack.back().first);
+			negate(evaluationStack.back().second);
+			continue;
+		}
+		auto right = evaluationStack.back();
+		evaluationStack.pop_back();
+		auto& left = evaluationStack.back();
+		if (operation.kind == EXPR_SUB) {
+			negate(right.second);
+		}
+		if (operation.kind != EXPR_ADD && operation.kind != EXPR_SUB && left.second != relocations.size()) {
+			returnErrorCode(ERR_SYNTAX, "Relocatable symbol outside of + and - in equ definition for " + name());
+		}
+		uint32_t a = left.first, b = right.first;
+		switch (operation.kind) {
+		case EXPR_ADD:
+			a += b;
+			break;
+		case EXPR_SUB:
+			a -= b;
+			break;
+		case EXPR_MUL:
+			a *= b;
+			break;
+		case EXPR_DIV:
+			if (b == 0) {
+				returnErrorCode(ERR_ARGUMENT, "Division by zero in equ definition for " + name());
 			}
-		} else {
-			if(positionMinus == std::string::npos) {
-				auto operand = expression.substr(0, positionPlus);
-				calculateExpression(literal, operation, operand);
-				expression.erase(0, positionPlus);
-			} else {
-				auto min = std::min(positionMinus, positionPlus);
-				auto operand = expression.substr(0, min);
-				calculateExpression(literal, operation, operand);
-				expression.erase(0, min);
+			// INT32_MIN / -1 wraps like the other operations
+			a = (right.first == -1) ? 0u - a : (uint32_t)(left.first / right.first);
+			break;
+		case EXPR_AND:
+			a &= b;
+			break;
+		case EXPR_OR:
+			a |= b;
+			break;
+		case EXPR_SHL:
+		case EXPR_SHR:
+			if (right.first < 0 || right.first > 31) {
+				returnErrorCode(ERR_ARGUMENT, "Shift count out of range in equ definition for " + name());
 			}
+			a = (operation.kind == EXPR_SHL) ? a << b : (uint32_t)(left.first >> b);
+			break;
 		}
+		left.first = (int32_t)a;
 	}
+	entry.value = (int16_t)evaluationStack.back().first;
 }
 
+// the prefix picks the base, like stoi the digits end at the first character that isn't one
+static std::from_chars_result parseNumber(std::string_view number, int64_t& value) {
+	int base = 10;
+	if (number.size() > 1 && number[0] == '0') {
+		if (number[1] == 'b') {
+			base = 2;
+		} else if (number[1] == 'o') {
+			base = 8;
+		} else if (number[1] == 'x') {
+			base = 16;
+		}
+		number.remove_prefix(base == 10 ? 0 : 2);
+	}
+	return std::from_chars(number.data(), number.data() + number.size(), value, base);
+}
 
-int16_t Assembler::toInt16_t(std::string str) {
-	int val = 0;
-	if(str[0] == '*') {
-		str.erase(0, 1);
+int16_t Assembler::toInt16_t(std::string_view number) {
+	int64_t val = 0;
+	if(number[0] == '*') {
+		number.remove_prefix(1);
 	}
-	if (str[0] == '0') {
-		if (str[1] == 'b')
-			val = stoi(str, nullptr, 2);
-		if (str[1] == 'o')
-			val = stoi(str, nullptr, 8);
-		if (str[1] == 'x')
-			val = stoi(str, nullptr, 16);
-	} else {
-		val = stoi(str, nullptr);
+	auto parsed = parseNumber(number, val);
+	if (parsed.ec == std::errc::invalid_argument) {
+		returnErrorCode(ERR_ARGUMENT, "Invalid number", number);
 	}
-
-	if(val > 65535) {
-		logger("Too large value used in word directive at line ",readingLineNumber);
-		returnErrorCode(ERR_ARGUMENT);
+	if(parsed.ec == std::errc::result_out_of_range || val > 65535 || val < INT16_MIN) {
+		returnErrorCode(ERR_ARGUMENT, "Too large value used in word directive", number);
 	}
 	return (int16_t) val;
 }
 
-int8_t Assembler::toInt8_t(std::string str) {
-	int val = 0;
-	if(str[0] == '*') {
-		str.erase(0, 1);
+int8_t Assembler::toInt8_t(std::string_view number) {
+	int64_t val = 0;
+	if(number[0] == '*') {
+		number.remove_prefix(1);
 	}
-	if (str[0] == '0') {
-		if (str[1] == 'b')
-			val = stoi(str, nullptr, 2);
-		if (str[1] == 'o')
-			val = stoi(str, nullptr, 8);
-		if (str[1] == 'x')
-			val = stoi(str, nullptr, 16);
-	} else {
-		val = stoi(str, nullptr);
+	auto parsed = parseNumber(number, val);
+	if (parsed.ec == std::errc::invalid_argument) {
+		returnErrorCode(ERR_ARGUMENT, "Invalid number", number);
 	}
-
-	if(val > 255) {
-		logger("Too large value used in byte directive at line ",readingLineNumber);
-		returnErrorCode(ERR_ARGUMENT);
+	if(parsed.ec == std::errc::result_out_of_range || val > 255 || val < INT8_MIN) {
+		returnErrorCode(ERR_ARGUMENT, "Too large value used in byte directive", number);
 	}
 
 	return (int8_t)val;
 }
 
-void Assembler::validateRegex() {
-	auto i = 0;
-	for (; i < numberOfRegex; i++) {
-		if (std::regex_search(readLine, matches, *allTheRegex[i].regex)) {
-			decypherRegex(i);
-			break;
+void Assembler::validateRegex(std::string_view line) {
+	if (!Lexer::classify(line, matches)) {
+		if (expandInvocation(line)) {
+			return;
 		}
+		returnErrorCode(ERR_SYNTAX, "Bad syntax in input file");
 	}
-	if (i == numberOfRegex) {
-		logger("Bad syntax in input file at line ",readingLineNumber);
-		returnErrorCode(ERR_SYNTAX);
+	encodeLine();
+}
+
+// the line in matches
+void Assembler::encodeLine() {
+	stats.counters.lineTypes[matches.type]++;
+	decypherRegex(matches.type);
+	if ((sections[currentSectionIndex].flags & SECTION_NOBITS) && code->dataSize() != 0) {
+		returnErrorCode(ERR_SECTION, "Only .skip, .zero, .align and .fill allowed in .bss");
+	}
+}
+
+bool Assembler::blockBody() {
+	lineMatch probe;
+	auto classified = Lexer::classify(readLine, probe);
+	if (classified && (probe.type == regexEndm || probe.type == regexEndr)) {
+		if (probe.type != ((defining == BLOCK_MACRO) ? regexEndm : regexEndr)) {
+			returnErrorCode(ERR_SYNTAX, (defining == BLOCK_MACRO) ? "Expected .endm" : "Expected .endr");
+		}
+		stats.counters.lineTypes[probe.type]++;
+		finishBlock();
+		return true;
+	}
+	// a section line ends the body, the block is dropped and the line parsed as usual
+	if (classified && probe.type == regexSection) {
+		auto missing = (defining == BLOCK_MACRO) ? "Missing .endm" : "Missing .endr";
+		defining = BLOCK_NONE;
+		recover(AssemblyError(ERR_SYNTAX, blockLine, missing, 1));
+		return false;
 	}
+	blockLines.push_back(readLine);
+	return true;
 }
 
-void Assembler::createBackpatchEntry(std::string symbol, char operation,
-		uint8_t bytes, std::string relocationType) {
-	TII[symbol].push_back( { currentSectionSymbolNumber, locationCounter,
-			operation, bytes, relocationType });
+void Assembler::finishBlock() {
+	auto block = defining;
+	defining = BLOCK_NONE;
+	macroDefinition definition;
+	size_t badLine;
+	if (!MacroCompiler::compile(blockLines, blockParameters, definition, badLine)) {
+		auto line = blockLines[badLine];
+		auto message = "Section lines, .macro and .rept not allowed in a block";
+		logger.error(message, " at line ", blockLine + 1 + badLine);
+		throw AssemblyError(ERR_SYNTAX, blockLine + 1 + badLine, message, line.find_first_not_of(" \t") + 1);
+	}
+	if (block == BLOCK_MACRO) {
+		auto id = macroNames.intern(blockName);
+		if (id >= macros.size()) {
+			macros.resize(id + 1);
+		}
+		macros[id] = std::move(definition);
+		// the whole definition, .macro line to .endm line
+		auto text = std::string_view(blockStart, readLine.data() + readLine.size() - blockStart);
+		macroHash = macroHash * 0x100000001b3ULL ^ SectionCache::hash(text);
+		stats.counters.macroDefinitions++;
+		return;
+	}
+	stats.counters.reptExpansions++;
+	std::vector<std::string_view> none;
+	for (uint16_t i = 0; i < blockCount; i++) {
+		expand(definition, none);
+	}
 }
 
-int Assembler::autoRelocation(std::string symbol, char operation, std::string relocationType) {
+bool Assembler::expandInvocation(std::string_view line) {
+	std::string_view label, name;
+	std::vector<std::string_view> arguments;
+	if (macros.empty() || !MacroCompiler::splitInvocation(line, label, name, arguments)) {
+		return false;
+	}
+	auto id = macroNames.find(name);
+	if (id == Interner::NOT_FOUND) {
+		return false;
+	}
+	auto& definition = macros[id];
+	if (arguments.size() != definition.parameters) {
+		returnErrorCode(ERR_ARGUMENT, "Macro " + std::string(name) + " takes " + std::to_string(definition.parameters)
+				+ " arguments", name);
+	}
+	if (!label.empty()) {
+		checkSection();
+		resolveSymbol(label);
+	}
+	stats.counters.macroExpansions++;
+	expand(definition, arguments);
+	return true;
+}
+
+void Assembler::expand(const macroDefinition& definition, const std::vector<std::string_view>& arguments) {
+	if (expansionDepth == MAX_EXPANSION_DEPTH) {
+		returnErrorCode(ERR_SYNTAX, "Macro expansions nested too deep");
+	}
+	auto suffix = "__" + std::to_string(expansions++);
+	auto& buffer = expansionBuffers[expansionDepth++];
+	for (auto& line : definition.lines) {
+		stats.counters.expandedLines++;
+		if (!MacroCompiler::expand(line, arguments, suffix, buffer, matches)) {
+			returnErrorCode(ERR_SYNTAX, "Bad syntax in input file after macro substitution");
+		}
+		if (line.type == UNCLASSIFIED) {
+			stats.counters.relexedLines++;
+			validateRegex(matches.group[0]);
+		} else {
+			encodeLine();
+		}
+	}
+	expansionDepth--;
+}
+
+std::string Assembler::findInclude(std::string_view name) {
+	std::string file(name);
+	if (file[0] == '/') {
+		return (access(file.c_str(), R_OK) == 0) ? file : "";
+	}
+	auto including = (currentFile == 0) ? sourcePath : sourceFiles[currentFile];
+	auto slash = including.rfind('/');
+	std::vector<std::string> directories { (slash == std::string::npos) ? "" : including.substr(0, slash + 1) };
+	for (auto& path : includePaths) {
+		directories.push_back((path != "" && path.back() != '/') ? path + "/" : path);
+	}
+	for (auto& directory : directories) {
+		if (access((directory + file).c_str(), R_OK) == 0) {
+			return directory + file;
+		}
+	}
+	return "";
+}
+
+void Assembler::include(std::string_view name) {
+	auto path = findInclude(name);
+	if (path == "") {
+		returnErrorCode(ERR_FOPEN, "Included file not found", name);
+	}
+	if (std::find(includeStack.begin(), includeStack.end(), path) != includeStack.end()) {
+		returnErrorCode(ERR_SYNTAX, "Recursive include of " + path, name);
+	}
+	if (includeStack.size() == MAX_INCLUDE_DEPTH) {
+		returnErrorCode(ERR_SYNTAX, "Includes nested too deep", name);
+	}
+	bool cached;
+	auto file = IncludeCache::shared().get(path, cached);
+	if (!file) {
+		returnErrorCode(ERR_FOPEN, "Error while trying to open included file", name);
+	}
+	stats.counters.includes++;
+	stats.counters.cachedIncludes += cached;
+	logger.info("Including ", path, cached ? ", lexed before" : "");
+
+	// the including line goes on after the file
+	auto line = readLine;
+	auto lineNumber = readingLineNumber;
+	auto parent = currentFile;
+	auto depth = expansionDepth;
+	currentFile = sourceFiles.size();
+	sourceFiles.push_back(path);
+	includeStack.push_back(path);
+	std::string_view text = file->text;
+	for (size_t i = 0; i < file->lines.size() && !stopped && !foundEnd; i++) {
+		auto& entry = file->lines[i];
+		readLine = text.substr(entry.offset, entry.length);
+		readingLineNumber = i + 1;
+		stats.counters.includedLines++;
+		try {
+			if (defining != BLOCK_NONE && blockBody()) {
+				continue;
+			}
+			if (entry.type == UNCLASSIFIED) {
+				validateRegex(readLine);
+				continue;
+			}
+			matches.type = entry.type;
+			matches.instruction = entry.instruction;
+			for (uint8_t g = 0; g < 5; g++) {
+				matches.group[g] = text.substr(entry.groupOffset[g], entry.groupLength[g]);
+			}
+			encodeLine();
+		} catch (AssemblyError& error) {
+			expansionDepth = depth;
+			recover(error);
+		}
+	}
+	// blocks don't cross file boundaries
+	if (defining != BLOCK_NONE && !stopped) {
+		recover(AssemblyError(ERR_SYNTAX, blockLine, (defining == BLOCK_MACRO) ? "Missing .endm" : "Missing .endr", 1));
+	}
+	defining = BLOCK_NONE;
+	includeStack.pop_back();
+	currentFile = parent;
+	readingLineNumber = lineNumber;
+	readLine = line;
+	matches.type = regexInclude;
+}
+
+void Assembler::createBackpatchEntry(uint32_t symbol, char operation,
+		uint8_t bytes, uint8_t relocationType) {
+	if (relocationType == LITERAL) {
+		stats.counters.literalBackpatches++;
+	} else {
+		stats.counters.forwardReferences++;
+	}
+	addBackpatch(symbol, { currentSectionSymbolNumber, locationCounter, operation, bytes, relocationType,
+			(uint32_t)readingLineNumber, currentFile });
+}
+
+int Assembler::autoRelocation(uint32_t symbol, char operation, uint8_t relocationType) {
 	int value = 0;
 	if (checkSymbolIsLiteral(symbol)) {
 		createBackpatchEntry(symbol, operation, 2, LITERAL);
 	} else {
 		if (checkSymbolExists(symbol)) {
+			auto& entry = identifiers[symbol].symbol;
 			if(checkSymbolIsExtern(symbol) || checkSymbolIsGlobal(symbol)) {
-				if(checkSymbolIsGlobal(symbol) && relocationType == R_PC16 && symbolTable[symbol].sectionNumber == currentSectionSymbolNumber) {
-					value = symbolTable[symbol].offset - locationCounter;
+				if(checkSymbolIsGlobal(symbol) && relocationType == R_PC16 && entry.sectionNumber == currentSectionSymbolNumber) {
+					value = entry.offset - locationCounter;
 				} else {
-					createRelocation(symbolTable[symbol].number, relocationType, operation);
+					createRelocation(entry.number, relocationType, operation);
 				}
 			} else {
 				if(checkSymbolIsDefined(symbol)) {
-					if(relocationType != R_PC16 || symbolTable[symbol].sectionNumber != currentSectionSymbolNumber){
-						value = symbolTable[symbol].offset;
-						createRelocation(symbolTable[symbol].sectionNumber, relocationType, operation);
+					if(relocationType != R_PC16 || entry.sectionNumber != currentSectionSymbolNumber){
+						value = entry.offset;
+						createRelocation(entry.sectionNumber, relocationType, operation);
 					} else {
-						value = symbolTable[symbol].offset - locationCounter;
+						value = entry.offset - locationCounter;
 					}
 				} else {
 					createBackpatchEntry(symbol, operation, 2, relocationType);
@@ -638,67 +1434,145 @@ void Assembler::decypherRegex(int i) {
 
 	case regexSection:
 	{
-		auto section = get(SECTION);
-		if (currentSection != "UNDEFINED") {
-			symbolTable[currentSection].size = locationCounter;
-			sectionTable[currentSection].sectionSize = locationCounter;
+		auto name = get(SECTION);
+		if (currentSectionSymbolNumber != UNDEFINED_SECTION) {
+			identifiers[currentSection].symbol.size = locationCounter;
+			sections[currentSectionIndex].sectionSize = locationCounter;
+			if (spill.isOpen() && !sections[currentSectionIndex].spilled) {
+				spillSection();
+			}
 		}
 
 		locationCounter = 0;
 
-		if (section == "end") {
+		if (name == "end") {
 			foundEnd = true;
 			return;
 		}
 
+		auto section = identify(name);
 		if (checkSymbolIsLiteral(section)) {
-			logger("Multiple definitions of symbol at line ",readingLineNumber);
-			returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+			returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Multiple definitions of symbol", name);
 		}
 		if (checkSymbolExists(section)) {
 			if (checkSymbolIsDefined(section)) {
-				logger("Multiple definitions of section at line ",readingLineNumber);
-				returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+				returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Multiple definitions of section", name);
 			}
-			auto& symbol = symbolTable.at(section);
+			auto& symbol = identifiers[section].symbol;
 			symbol.sectionNumber = symbol.number;
 			symbol.offset = 0;
-			symbol.type = "local";
-			symbol.symbolType = "section";
-			sectionTable.insert( { section, { 0, symbol.number } });
-			sectionTranslation.insert({symbol.number, section});
-			currentSectionSymbolNumber = symbol.number;
+			symbol.type = SYM_LOCAL;
+			symbol.symbolType = SYM_SECTION;
 		} else {
 			++symbolNumber;
-			symbolTable.insert( { section, { symbolNumber, symbolNumber, locationCounter, "local", 0, "section" } });
-			sectionTable.insert( { section, { 0, symbolNumber } });
-			sectionTranslation.insert( {symbolNumber, section});
-			currentSectionSymbolNumber = symbolNumber;
+			addSymbol(section, { symbolNumber, symbolNumber, locationCounter, SYM_LOCAL, 0, SYM_SECTION });
+		}
+		currentSectionSymbolNumber = identifiers[section].symbol.number;
+		currentSectionIndex = sections.size();
+		sections.push_back( { section, currentSectionSymbolNumber, 0, SectionBuffer(&codeArena), { },
+				(uint16_t)((name == "bss") ? SECTION_NOBITS : 0), false, 0, 0 });
+		code = &sections.back().code;
+		if (currentSectionSymbolNumber >= sectionIndex.size()) {
+			sectionIndex.resize(currentSectionSymbolNumber + 1, 0);
 		}
+		sectionIndex[currentSectionSymbolNumber] = currentSectionIndex;
 		currentSection = section;
 	}
 		break;
 
 	case regexEqu:
 	{
-		if (currentSection != "UNDEFINED") {
-			logger("Error: out of section .equ only, line ",readingLineNumber);
-			returnErrorCode(ERR_SECTION);
+		if (currentSectionSymbolNumber != UNDEFINED_SECTION) {
+			returnErrorCode(ERR_SECTION, "Error: out of section .equ only");
 		}
-		auto symbol = get(SYMBOL);
+		auto symbol = identify(get(SYMBOL));
 		if (checkSymbolIsLiteral(symbol) || checkSymbolExists(symbol)) {
-			logger("EQU defined symbol already exists at line ",readingLineNumber);
-			returnErrorCode(ERR_MULTIPLE_DEFINITIONS);
+			returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "EQU defined symbol already exists", get(SYMBOL));
+		}
+		auto expression = get(EXPRESSION);
+		compiledLiteral compiled { symbol, (uint32_t)expressionCode.size(), 0, LITERAL_PENDING };
+		size_t errorAt;
+		std::string error;
+		expressionNames.clear();
+		if (!Expression::compile(expression, expressionCode, expressionNames, errorAt, error)) {
+			expressionCode.resize(compiled.start);
+			returnErrorCode(ERR_SYNTAX, error, expression.substr(errorAt));
 		}
-		literalTable.insert( { symbol, { get(EXPRESSION), 0 } });
+		compiled.length = expressionCode.size() - compiled.start;
+		for (auto token = compiled.start; token < expressionCode.size(); token++) {
+			if (expressionCode[token].kind == EXPR_SYMBOL) {
+				expressionCode[token].value = identify(expressionNames[expressionCode[token].value]);
+			}
+		}
+		identifiers[symbol].kind = ID_LITERAL;
+		identifiers[symbol].literal = literals.size();
+		literals.push_back( { std::string(expression), 0, { }, (uint32_t)readingLineNumber, currentFile });
+		compiledLiterals.push_back(compiled);
 	}
 		break;
 
+	case regexMacro:
+	{
+		if (currentSectionSymbolNumber != UNDEFINED_SECTION) {
+			returnErrorCode(ERR_SECTION, "Error: out of section .macro only");
+		}
+		if (expansionDepth != 0) {
+			returnErrorCode(ERR_SYNTAX, "Macro defined inside an expansion");
+		}
+		auto name = get(SYMBOL);
+		isaInstruction instruction;
+		if (decodeMnemonic(name, instruction) || macroNames.find(name) != Interner::NOT_FOUND) {
+			returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Macro name already defined", name);
+		}
+		parserComma(get(LIST), blockParameters);
+		for (size_t i = 0; i < blockParameters.size(); i++) {
+			if (std::find(blockParameters.begin(), blockParameters.begin() + i, blockParameters[i])
+					!= blockParameters.begin() + i) {
+				returnErrorCode(ERR_MULTIPLE_DEFINITIONS, "Duplicate macro parameter", blockParameters[i]);
+			}
+		}
+		blockName = name;
+		blockLines.clear();
+		blockLine = readingLineNumber;
+		blockStart = readLine.data();
+		defining = BLOCK_MACRO;
+	}
+		break;
+
+	case regexRept:
+	{
+		if (expansionDepth != 0) {
+			returnErrorCode(ERR_SYNTAX, "Repetition inside an expansion");
+		}
+		if (!get(LABEL).empty()) {
+			checkSection();
+			resolveSymbol(get(LABEL));
+		}
+		blockCount = toCount(get(LIST));
+		blockParameters.clear();
+		blockLines.clear();
+		blockLine = readingLineNumber;
+		blockStart = readLine.data();
+		defining = BLOCK_REPT;
+	}
+		break;
+
+	case regexInclude:
+		if (expansionDepth != 0) {
+			returnErrorCode(ERR_SYNTAX, "Include inside a macro expansion");
+		}
+		include(get(SYMBOL));
+		break;
+
+	case regexEndm:
+	case regexEndr:
+		returnErrorCode(ERR_SYNTAX, (i == regexEndm) ? "Unexpected .endm" : "Unexpected .endr");
+		break;
+
 	case regexGlobal:
 	{
-		if (currentSection != "UNDEFINED") {
-			logger("Error: out of section .global only, line ",readingLineNumber);
-			returnErrorCode(ERR_SECTION);
+		if (currentSectionSymbolNumber != UNDEFINED_SECTION) {
+			returnErrorCode(ERR_SECTION, "Error: out of section .global only");
 		}
 		addGlobal(get(SYMBOL));
 	}
@@ -706,9 +1580,8 @@ void Assembler::decypherRegex(int i) {
 
 	case regexExtern:
 	{
-		if (currentSection != "UNDEFINED") {
-			logger("Error: out of section .extern only, line ",readingLineNumber);
-			returnErrorCode(ERR_SECTION);
+		if (currentSectionSymbolNumber != UNDEFINED_SECTION) {
+			returnErrorCode(ERR_SECTION, "Error: out of section .extern only");
 		}
 		addExtern(get(SYMBOL));
 	}
@@ -720,30 +1593,29 @@ void Assembler::decypherRegex(int i) {
 		auto symbol = get(SYMBOL);
 		auto symbols = get(LIST);
 		resolveSymbol(symbol);
-		auto symbolVector = parserComma(symbols);
-		for (auto sym : symbolVector) {
+		parserComma(symbols, listItems);
+		for (auto sym : listItems) {
 			int8_t value = 0;
 			char operation = '+';
 			if (sym[0] == '-') {
 				operation = '-';
-				sym.erase(0, 1);
+				sym.remove_prefix(1);
 			}
 			if (sym[0] >= '0' && sym[0] <= '9') {
 				value = toInt8_t(sym);
 				if(operation == '-' && value == INT8_T_MIN) {
-					logger("Overflow value at byte directive, line number ",readingLineNumber);
-					returnErrorCode(ERR_ARGUMENT);
+					returnErrorCode(ERR_ARGUMENT, "Overflow value at byte directive", sym);
 				}
 				value = (operation == '+') ? value : 0 - value;
 			} else {
-				if (literalTable.find(sym) != literalTable.end()) {
-					createBackpatchEntry(sym, operation, 1, LITERAL);
+				auto literal = identify(sym);
+				if (checkSymbolIsLiteral(literal)) {
+					createBackpatchEntry(literal, operation, 1, LITERAL);
 				} else {
-					logger("Error, unavailable symbol in byte directive, line ",readingLineNumber);
-					returnErrorCode(ERR_SYNTAX);
+					returnErrorCode(ERR_SYNTAX, "Error, unavailable symbol in byte directive", sym);
 				}
 			}
-			machineCode[currentSectionSymbolNumber].push_back(value);
+			code->push(value);
 			locationCounter++;
 		}
 	}
@@ -755,28 +1627,25 @@ void Assembler::decypherRegex(int i) {
 		auto symbol = get(SYMBOL);
 		auto symbols = get(LIST);
 		resolveSymbol(symbol);
-		auto symbolVector = parserComma(symbols);
-		for (auto sym : symbolVector) {
+		parserComma(symbols, listItems);
+		for (auto sym : listItems) {
 			int16_t value = 0;
 			char operation = '+';
 			if (sym[0] == '-') {
 				operation = '-';
-				sym.erase(0, 1);
+				sym.remove_prefix(1);
 			}
 			if (sym[0] >= '0' && sym[0] <= '9') {
 				value = toInt16_t(sym);
 				if(operation == '-' && value == INT16_T_MIN) {
-					logger("Overflow value at word directive, line number ",readingLineNumber);
-					returnErrorCode(ERR_ARGUMENT);
+					returnErrorCode(ERR_ARGUMENT, "Overflow value at word directive", sym);
 				}
 				value = (operation == ADD) ? value : 0 - value;
 			} else {
-				value = autoRelocation(sym, operation, R_16);
+				value = autoRelocation(identify(sym), operation, R_16);
 			}
-			union ImmedValues val;
-			val.val = value;
-			machineCode[currentSectionSymbolNumber].push_back(val.byte1);
-			machineCode[currentSectionSymbolNumber].push_back(val.byte2);
+			code->push(value & 0xff);
+			code->push((uint16_t)value >> 8);
 			locationCounter += 2;
 		}
 	}
@@ -787,31 +1656,79 @@ void Assembler::decypherRegex(int i) {
 		checkSection();
 		auto symbol = get(SYMBOL);
 		resolveSymbol(symbol);
-		auto expr = get(EXPRESSION);
-		int16_t value = toInt16_t(expr);
-		if (value < 0) {
-			logger("Negative value in skip at line ",readingLineNumber);
-			returnErrorCode(ERR_SYNTAX);
+		fill(SKIP_FILL, toCount(get(EXPRESSION)));
+	}
+		break;
+
+	case regexZero:
+	{
+		checkSection();
+		resolveSymbol(get(SYMBOL));
+		fill(0, toCount(get(LIST)));
+	}
+		break;
+
+	case regexAlign:
+	{
+		checkSection();
+		resolveSymbol(get(SYMBOL));
+		parserComma(get(LIST), listItems);
+		if (listItems.size() > 2) {
+			returnErrorCode(ERR_SYNTAX, "Too many arguments in align directive", listItems[2]);
 		}
-		for(auto i = 0; i < value; i++) {
-		machineCode[currentSectionSymbolNumber].push_back(0x90);
+		auto alignment = toCount(listItems[0]);
+		if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+			returnErrorCode(ERR_ARGUMENT, "Alignment must be a power of two", listItems[0]);
 		}
-		locationCounter += value;
+		uint8_t value = (listItems.size() == 2) ? toInt8_t(listItems[1]) : SKIP_FILL;
+		fill(value, (alignment - (locationCounter & (alignment - 1))) & (alignment - 1));
 	}
 		break;
 
-	case regexInstrNoOperand:
+	case regexFill:
 	{
 		checkSection();
-		auto symbol = get(SYMBOL);
-		auto instruction = get(OPERATION);
-		resolveSymbol(symbol);
+		resolveSymbol(get(SYMBOL));
+		parserComma(get(LIST), listItems);
+		if (listItems.size() != 3 || listItems[0][0] == '-' || listItems[1][0] == '-') {
+			returnErrorCode(ERR_SYNTAX, "Fill directive takes count,size,value", get(LIST));
+		}
+		auto count = toCount(listItems[0]);
+		auto size = toCount(listItems[1]);
+		if (size != 1 && size != 2) {
+			returnErrorCode(ERR_ARGUMENT, "Fill size must be 1 or 2", listItems[1]);
+		}
+		auto text = listItems[2];
+		auto negative = text[0] == '-';
+		if (negative) {
+			text.remove_prefix(1);
+		}
+		int16_t value = (size == 1) ? toInt8_t(text) : toInt16_t(text);
+		if (negative) {
+			value = 0 - value;
+		}
+		uint8_t low = value & 0xff, high = (uint16_t)value >> 8;
+		if (size == 1 || low == high || (sections[currentSectionIndex].flags & SECTION_NOBITS)) {
+			fill(low, count * size);
+		} else {
+			// a two byte pattern isn't a run
+			if (locationCounter + count * 2 > UINT16_MAX) {
+				returnErrorCode(ERR_SECTION, "Section larger than 64KB");
+			}
+			for (uint32_t i = 0; i < count; i++) {
+				code->push(low);
+				code->push(high);
+			}
+			locationCounter += count * 2;
+		}
+	}
+		break;
 
-		union Mnemonics code;
-		code.val = 0;
-		code.opcode = MAPS::opCode[instruction];
-		code.size = 0;
-		machineCode[currentSectionSymbolNumber].push_back(code.val);
+	case regexInstrNoOperand:
+	{
+		checkSection();
+		resolveSymbol(get(SYMBOL));
+		code->push(instructionByte(matches.instruction.opcode, 0));
 		++locationCounter;
 	}
 		break;
@@ -819,620 +1736,209 @@ void Assembler::decypherRegex(int i) {
 	case regexInstrOneOperand:
 	{
 		checkSection();
-		auto symbol = get(SYMBOL);
-		auto instruction = get(OPERATION);
-		resolveSymbol(symbol);
+		resolveSymbol(get(SYMBOL));
+		auto instruction = matches.instruction;
 		auto argument1 = get(ARG1);
-
-		union Mnemonics mnemonic;
-		mnemonic.val = 0;
-		mnemonic.opcode = MAPS::opCode[instruction];
-		machineCode[currentSectionSymbolNumber].push_back(mnemonic.val);
+		encodedInstruction encoded;
+		encoded.push(instructionByte(instruction.opcode, 0));
 		locationCounter++;
 
-		union Addressing addr;
-		addr.val = 0;
-		union ImmedValues oper;
-		oper.val = 0;
-
-		std::string addrMode = "";
-
-		std::smatch operand;
-
-		/*
-		 * (1) *0xff(%r0), *0xff, 0xff
-		 * (2) *labela1(%r0), *labela2, labela3
-		 * (3) *%r0
-		 * (4) *%(r0)
-		 */
-
-		if (isJump(instruction)) {
-			std::regex_search(argument1, operand, operandJumpRegex);
-			for (int i = 1; i < 5; i++) {
-				if (operand.str(i) != "") {
-					std::string jumpAddr = operand.str(i);
-					switch (i) {
-
-					// *0xff(%r0), *0xff, 0xff
-					case 1:
-						if (jumpAddr[0] == '*') {
-							jumpAddr.erase(0, 1);
-							auto position = jumpAddr.find("(", 0);
-							if (position == std::string::npos) {
-								addrMode = MEMDIR;
-								addr.addressMode = MAPS::addressingMode[MEMDIR];
-								locationCounter++;
-								oper.val = toInt16_t(jumpAddr);
-								locationCounter += 2;
-							} else {
-								auto operand1literal = jumpAddr.substr(0, position);
-								jumpAddr.erase(0, operand1literal.length() + 2);
-								jumpAddr.erase(jumpAddr.length() - 1, 1);
-								auto operand1reg = jumpAddr;
-								addrMode = REGIND16B;
-								addr.addressMode = MAPS::addressingMode[REGIND16B];
-								addr.regs = MAPS::regs[operand1reg];
-								locationCounter++;
-								oper.val = toInt16_t(operand1literal);
-								locationCounter += 2;
-							}
-						} else {
-							addrMode = IMMED;
-							addr.addressMode = MAPS::addressingMode[IMMED];
-							locationCounter++;
-							oper.val = toInt16_t(jumpAddr);
-							locationCounter += 2;
-						}
-						machineCode[currentSectionSymbolNumber].push_back(addr.val);
-						machineCode[currentSectionSymbolNumber].push_back(oper.byte1);
-						machineCode[currentSectionSymbolNumber].push_back(oper.byte2);
-						break;
-
-					// *labela1(%r0), *labela2, labela3
-					case 2:
-						if (jumpAddr[0] == '*') {
-							jumpAddr.erase(0, 1);
-							auto position = jumpAddr.find('(', 0);
-							if (position == std::string::npos) {
-								addrMode = MEMDIR;
-								addr.addressMode = MAPS::addressingMode[MEMDIR];
-								locationCounter++;
-								oper.val = autoRelocation(jumpAddr, ADD, R_16);
-								locationCounter += 2;
-							} else {
-								auto operand1label = jumpAddr.substr(0, position);
-								jumpAddr.erase(0, operand1label.length() + 2);
-								jumpAddr.erase(jumpAddr.length() - 1, 1);
-								auto operand1reg = jumpAddr;
-								addrMode = REGIND16B;
-								addr.addressMode = MAPS::addressingMode[REGIND16B];
-								addr.regs = MAPS::regs[operand1reg];
-								locationCounter++;
-								if (operand1reg == "pc" || operand1reg == "r7") {
-									if (checkSymbolIsLiteral(operand1label)) {
-										oper.val = autoRelocation(operand1label, ADD, R_16);
-									} else {
-										oper.val = -2;
-										oper.val = oper.val + autoRelocation(operand1label, ADD, R_PC16);
-									}
-									locationCounter += 2;
-								} else {
-									oper.val = autoRelocation(operand1label, ADD, R_16);
-									locationCounter += 2;
-								}
-							}
-						} else {
-							addrMode = IMMED;
-							addr.addressMode = MAPS::addressingMode[IMMED];
-							locationCounter++;
-							oper.val = autoRelocation(jumpAddr, ADD, R_16);
-							locationCounter += 2;
-						}
-						machineCode[currentSectionSymbolNumber].push_back(addr.val);
-						machineCode[currentSectionSymbolNumber].push_back(oper.byte1);
-						machineCode[currentSectionSymbolNumber].push_back(oper.byte2);
-						break;
-
-					// *%r0
-					case 3:
-						jumpAddr.erase(0, 2);
-						addrMode = REGDIR;
-						addr.addressMode = MAPS::addressingMode[REGDIR];
-						addr.regs = MAPS::regs[jumpAddr];
-						locationCounter++;
-						machineCode[currentSectionSymbolNumber].push_back(addr.val);
-						break;
-
-					// *%(r0)
-					case 4:
-						jumpAddr.erase(0, 3);
-						jumpAddr.erase(jumpAddr.length() - 1, 1);
-						addrMode = REGIND;
-						addr.addressMode = MAPS::addressingMode[REGIND];
-						addr.regs = MAPS::regs[jumpAddr];
-						locationCounter++;
-						machineCode[currentSectionSymbolNumber].push_back(addr.val);
-						break;
-					}
-					break;
-				}
-			}
-
-		} else {	// push pop
-			std::regex_search(argument1, operand, operandInstructionRegex);
-			for (int i = 1; i < 5; i++) {
-				if (operand.str(i) != "") {
-					std::string operand1 = operand.str(i);
-					switch(i) {
-					// 0xff(%r0), $0xff, 0xff
-					case 1:
-						if(operand1[0] == '$' && operand1.find('(', 0) != std::string::npos) {
-							logger("Bad operand format, $literal(%r<num) at line ",readingLineNumber);
-							returnErrorCode(ERR_ARGUMENT);
-						}
-						if(operand1[0] == '$') {
-							operand1.erase(0, 1);
-							addrMode = IMMED;
-							addr.addressMode = MAPS::addressingMode[IMMED];
-							locationCounter++;
-							oper.val = toInt16_t(operand1);
-							locationCounter += 2;
-						} else {
-							auto position = operand1.find('(',0);
-							if(position == std::string::npos) {
-								addrMode = MEMDIR;
-								addr.addressMode = MAPS::addressingMode[MEMDIR];
-								locationCounter++;
-								oper.val = toInt16_t(operand1);
-								locationCounter+= 2;
-							} else {
-								auto operand1Literal = operand1.substr(0, position);
-								operand1.erase(0, operand1Literal.length() + 2);
-								operand1.erase(operand1.length() - 1, 1);
-								auto operand1Reg = operand1;
-								addrMode = REGIND16B;
-								addr.addressMode = MAPS::addressingMode[REGIND16B];
-								addr.regs = MAPS::regs[operand1Reg];
-								locationCounter++;
-								oper.val = toInt16_t(operand1Literal);
-								locationCounter += 2;
-							}
-						}
-						break;
-
-					// labela1(%r0), $labela2, labela3
-					case 2:
-						if(operand1[0] == '$' && operand1.find('(', 0) != std::string::npos) {
-							logger("Bad operand format, $symbol(%r<num) at line ",readingLineNumber);
-							returnErrorCode(ERR_ARGUMENT);
-						}
-						if(operand1[0] == '$') {
-							operand1.erase(0, 1);
-							addrMode = IMMED;
-							addr.addressMode = MAPS::addressingMode[IMMED];
-							locationCounter++;
-							oper.val = autoRelocation(operand1, ADD, R_16);
-							locationCounter += 2;
-						} else {
-							auto position = operand1.find('(',0);
-							if(position == std::string::npos) {
-								addrMode = MEMDIR;
-								addr.addressMode = MAPS::addressingMode[MEMDIR];
-								locationCounter++;
-								oper.val = autoRelocation(operand1, ADD, R_16);
-								locationCounter += 2;
-							} else {
-								auto operand1Label = operand1.substr(0, position);
-								operand1.erase(0, operand1Label.length() + 2);
-								operand1.erase(operand1.length() - 1, 1);
-								auto operand1Reg = operand1;
-								addrMode = REGIND16B;
-								addr.addressMode = MAPS::addressingMode[REGIND16B];
-								addr.regs = MAPS::regs[operand1Reg];
-								locationCounter++;
-								if(operand1Reg == "pc" || operand1Reg == "r7") {
-									if(checkSymbolIsLiteral(operand1Label)) {
-										oper.val = autoRelocation(operand1Label, ADD, LITERAL);
-									} else {
-										oper.val = -2;
-										oper.val = oper.val + autoRelocation(operand1Label, ADD, R_PC16);
-									}
-								} else {
-									oper.val = autoRelocation(operand1Label, ADD, R_16);
-								}
-								locationCounter += 2;
-							}
-						}
-						break;
-
-					// %r0
-					case 3:
-						operand1.erase(0, 1);
-						addrMode = REGDIR;
-						addr.addressMode = MAPS::addressingMode[REGDIR];
-						addr.regs = MAPS::regs[operand1];
-						locationCounter++;
-						break;
-
-					// %(r0)
-					case 4:
-						operand1.erase(0, 2);
-						operand1.erase(operand1.length() - 1, 1);
-						addrMode = REGIND;
-						addr.addressMode = MAPS::addressingMode[REGIND];
-						addr.regs = MAPS::regs[operand1];
-						locationCounter++;
-						break;
-					}
-					break;
-				}
-			}
-
-			if(instruction == "pop" && addrMode == IMMED) {
-				logger("Pop + immed illegal combination, line number ",readingLineNumber);
-				returnErrorCode(ERR_ARGUMENT);
-			}
-
-			machineCode[currentSectionSymbolNumber].push_back(addr.val);
-
-			if(addrMode == IMMED || addrMode == REGIND16B || addrMode == MEMDIR) {
-				machineCode[currentSectionSymbolNumber].push_back(oper.byte1);
-				machineCode[currentSectionSymbolNumber].push_back(oper.byte2);
-			}
+		instructionOperand operand;
+		parseOperand(argument1, ISA[instruction.opcode].jump, operand);
+		auto value = operandValue(operand, instruction, argument1);
+		if (instruction.opcode == OP_POP && operand.mode == IMMED) {
+			returnErrorCode(ERR_ARGUMENT, "Pop + immed illegal combination", argument1);
 		}
+		encodeOperand(operand, value, instruction, encoded);
+		code->append(encoded.bytes, encoded.length);
 	}
 		break;
 
 	case regexInstrTwoOperand:
 	{
 		checkSection();
-		auto symbol = get(SYMBOL);
-		resolveSymbol(symbol);
-		auto instruction = get(OPERATION);
+		resolveSymbol(get(SYMBOL));
+		auto instruction = matches.instruction;
 		auto argument1 = get(ARG1);
 		auto argument2 = get(ARG2);
-		std::smatch operand;
-		bool isPcRel = false;
-		std::regex_search(argument1, operand, operandInstructionRegex);
-		union Mnemonics mnemonic;
-		mnemonic.val = 0;
-		mnemonic.opcode = MAPS::opCode[instruction];
-		auto operandSize = MAPS::operandSize[instruction];
-		mnemonic.size = operandSize;
-		machineCode[currentSectionSymbolNumber].push_back(mnemonic.val);
+		encodedInstruction encoded;
+		encoded.push(instructionByte(instruction.opcode, instruction.size));
 		locationCounter++;
 
-		// **************************************************
-		// Operand 1
-		// **************************************************
-
-		union Addressing addr1;
-		addr1.val = 0;
-		union ImmedValues oper1;
-		oper1.val = 0;
-		std::string addr1Mode = "";
-
-		/*
-		 * (1) 0xff(%r0), $0xff, 0xff
-		 * (2) labela1(%r0), $labela2, labela3
-		 * (3) %r0
-		 * (4) %(r0)
-		 */
-		for (int i = 1; i < 5; i++) {
-			if (operand.str(i) != "") {
-				std::string operand1 = operand.str(i);
-				switch(i) {
-				// 0xff(%r0), $0xff, 0xff
-				case 1:
-					if(operand1[0] == '$' && operand1.find('(', 0) != std::string::npos) {
-						logger("Bad operand format, $literal(%r<num) at line ",readingLineNumber);
-						returnErrorCode(ERR_ARGUMENT);
-					}
-					if(operand1[0] == '$') {
-						operand1.erase(0, 1);
-						addr1Mode = IMMED;
-						addr1.addressMode = MAPS::addressingMode[IMMED];
-						locationCounter++;
-						if(operandSize) {
-							oper1.val = toInt16_t(operand1);
-							locationCounter += 2;
-						} else {
-							oper1.val = toInt8_t(operand1);
-							locationCounter++;
-						}
-					} else {
-						auto position = operand1.find('(',0);
-						if(position == std::string::npos) {
-							if(operand1[0] == '-') {
-								logger("Negative address at line ",readingLineNumber);
-								returnErrorCode(ERR_SYNTAX);
-							}
-							addr1Mode = MEMDIR;
-							addr1.addressMode = MAPS::addressingMode[MEMDIR];
-							locationCounter++;
-							oper1.val = toInt16_t(operand1);
-							locationCounter+= 2;
-						} else {
-							auto operand1Literal = operand1.substr(0, position);
-							operand1.erase(0,operand1Literal.length() + 2);
-							operand1.erase(operand1.length() - 1, 1);
-							auto operand1Reg = operand1;
-							addr1Mode = REGIND16B;
-							addr1.addressMode = MAPS::addressingMode[REGIND16B];
-							addr1.regs = MAPS::regs[operand1Reg];
-							locationCounter++;
-							oper1.val = toInt16_t(operand1Literal);
-							locationCounter += 2;
-						}
-					}
-					break;
-
-				// labela1(%r0), $labela2, labela3
-				case 2:
-					if(operand1[0] == '$' && operand1.find('(', 0) != std::string::npos) {
-						logger("Bad operand format, $symbol(%r<num>) at line ",readingLineNumber);
-						returnErrorCode(ERR_ARGUMENT);
-					}
-					if(operand1[0] == '$') {
-						operand1.erase(0, 1);
-						addr1Mode = IMMED;
-						addr1.addressMode = MAPS::addressingMode[IMMED];
-						locationCounter++;
-						oper1.val = autoRelocation(operand1, ADD, R_16);
-						locationCounter += 2;
-					} else {
-						auto position = operand1.find('(',0);
-						if(position == std::string::npos) {
-							addr1Mode = MEMDIR;
-							addr1.addressMode = MAPS::addressingMode[MEMDIR];
-							locationCounter++;
-							oper1.val = autoRelocation(operand1, ADD, R_16);
-							locationCounter += 2;
-						} else {
-							auto operand1Label = operand1.substr(0, position);
-							operand1.erase(0, operand1Label.length() + 2);
-							operand1.erase(operand1.length() - 1, 1);
-							auto operand1Reg = operand1;
-							addr1Mode = REGIND16B;
-							addr1.addressMode = MAPS::addressingMode[REGIND16B];
-							addr1.regs = MAPS::regs[operand1Reg];
-							locationCounter++;
-							if(operand1Reg == "pc" || operand1Reg == "r7") {
-								if(checkSymbolIsLiteral(operand1Label)) {
-									oper1.val = autoRelocation(operand1Label, ADD, LITERAL);
-								} else {
-									isPcRel = true;
-									oper1.val = autoRelocation(operand1Label, ADD, R_PC16);
-								}
-							} else {
-								oper1.val = autoRelocation(operand1Label, ADD, R_16);
-							}
-							locationCounter += 2;
-						}
-					}
-					break;
-
-				// %r0
-				case 3:
-					operand1.erase(0, 1);
-					addr1Mode = REGDIR;
-					addr1.addressMode = MAPS::addressingMode[REGDIR];
-					addr1.regs = MAPS::regs[operand1];
-					if(operandSize == 0) {
-						addr1.part = (operand1[operand1.length() - 1] == 'l') ? 0 : 1;
-					}
-					locationCounter++;
-					break;
-
-				// %(r0)
-				case 4:
-					operand1.erase(0, 2);
-					operand1.erase(operand1.length() - 1, 1);
-					addr1Mode = REGIND;
-					addr1.addressMode = MAPS::addressingMode[REGIND];
-					addr1.regs = MAPS::regs[operand1];
-					locationCounter++;
-					break;
-				}
-				break;
-			}
-		}
-
-		// **************************************************
-		// Operand 2
-		// **************************************************
-
-		std::regex_search(argument2, operand, operandInstructionRegex);
-
-		union Addressing addr2;
-		addr2.val = 0;
-		union ImmedValues oper2;
-		oper2.val = 0;
-		std::string addr2Mode = "";
-
-		/*
-		 * (1) 0xff(%r0), $0xff, 0xff
-		 * (2) labela1(%r0), $labela2, labela3
-		 * (3) %r0
-		 * (4) %(r0)
-		 */
-
-		for(int i = 1; i < 5; i++) {
-			if(operand.str(i) != "") {
-				std::string operand2 = operand.str(i);
-				switch(i) {
-				// 0xff(%r0), $0xff, 0xff
-				case 1:
-					if(operand2[0] == '$' && operand2.find('(', 0) != std::string::npos) {
-						logger("Bad operand format, $literal(%r<num>) at line ",readingLineNumber);
-						returnErrorCode(ERR_ARGUMENT);
-					}
-					if(operand2[0] == '$') {
-						operand2.erase(0, 1);
-						addr2Mode = IMMED;
-						addr2.addressMode = MAPS::addressingMode[IMMED];
-						locationCounter++;
-						if(operandSize) {
-							oper2.val = toInt16_t(operand2);
-							locationCounter += 2;
-						} else {
-							oper2.val = toInt8_t(operand2);
-							locationCounter++;
-						}
-					} else {
-						auto position = operand2.find('(',0);
-						if(position == std::string::npos) {
-							if(operand2[0] == '-') {
-								logger("Negative address at line ",readingLineNumber);
-								returnErrorCode(ERR_SYNTAX);
-							}
-							addr2Mode = MEMDIR;
-							addr2.addressMode = MAPS::addressingMode[MEMDIR];
-							locationCounter++;
-							oper2.val = toInt16_t(operand2);
-							locationCounter+= 2;
-						} else {
-							auto operand2Literal = operand2.substr(0, position);
-							operand2.erase(0,operand2Literal.length() + 2);
-							operand2.erase(operand2.length() - 1, 1);
-							auto operand2Reg = operand2;
-							addr2Mode = REGIND16B;
-							addr2.addressMode = MAPS::addressingMode[REGIND16B];
-							addr2.regs = MAPS::regs[operand2Reg];
-							locationCounter++;
-							oper2.val = toInt16_t(operand2Literal);
-							locationCounter += 2;
-						}
-					}
-					break;
+		instructionOperand operand1, operand2;
+		parseOperand(argument1, false, operand1);
+		auto value1 = operandValue(operand1, instruction, argument1);
+		parseOperand(argument2, false, operand2);
+		auto value2 = operandValue(operand2, instruction, argument2);
 
-				// labela1(%r0), $labela2, labela3
-				case 2:
-
-					if(operand2[0] == '$' && operand2.find('(', 0) != std::string::npos) {
-						logger("Bad operand format, $symbol(%r<num) at line ",readingLineNumber);
-						returnErrorCode(ERR_ARGUMENT);
-					}
-					if(operand2[0] == '$') {
-						operand2.erase(0, 1);
-						addr2Mode = IMMED;
-						addr2.addressMode = MAPS::addressingMode[IMMED];
-						locationCounter++;
-						oper2.val = autoRelocation(operand2, ADD, R_16);
-						locationCounter += 2;
-					} else {
-						auto position = operand2.find('(',0);
-						if(position == std::string::npos) {
-							addr2Mode = MEMDIR;
-							addr2.addressMode = MAPS::addressingMode[MEMDIR];
-							locationCounter++;
-							oper2.val = autoRelocation(operand2, ADD, R_16);
-							locationCounter += 2;
-						} else {
-							auto operand2Label = operand2.substr(0, position);
-							operand2.erase(0, operand2Label.length() + 2);
-							operand2.erase(operand2.length() - 1, 1);
-							auto operand2Reg = operand2;
-							addr2Mode = REGIND16B;
-							addr2.addressMode = MAPS::addressingMode[REGIND16B];
-							addr2.regs = MAPS::regs[operand2Reg];
-							locationCounter++;
-							if(operand2Reg == "pc" || operand2Reg == "r7") {
-								if(checkSymbolIsLiteral(operand2Label)) {
-									oper2.val = autoRelocation(operand2Label, ADD, LITERAL);
-								} else {
-									oper2.val = -2;
-									oper2.val = oper2.val + autoRelocation(operand2Label, ADD, R_PC16);
-								}
-							} else {
-								oper2.val = autoRelocation(operand2Label, ADD, R_16);
-							}
-							locationCounter += 2;
-						}
-					}
-					break;
-
-				// %r0
-				case 3:
-					operand2.erase(0, 1);
-					addr2Mode = REGDIR;
-					addr2.addressMode = MAPS::addressingMode[REGDIR];
-					addr2.regs = MAPS::regs[operand2];
-					if(operandSize == 0) {
-						addr2.part = (operand2[operand2.length() - 1] == 'l') ? 0 : 1;
-					}
-					locationCounter++;
-					break;
-
-				// %(r0)
-				case 4:
-					operand2.erase(0, 2);
-					operand2.erase(operand2.length() - 1, 1);
-					addr2Mode = REGIND;
-					addr2.addressMode = MAPS::addressingMode[REGIND];
-					addr2.regs = MAPS::regs[operand2];
-					locationCounter++;
-					break;
-				}
-				break;
-			}
+		// proveri dozvoljena adresiranja sa instrukcijama, shr je jedino src, dst
+		if (operand1.mode == IMMED && instruction.opcode == OP_SHR) {
+			returnErrorCode(ERR_SYNTAX, "Illegal addressing for shr dst, src", argument1);
 		}
-
-// proveri dozvoljena adresiranja sa instrukcijama, shr je jedino src, dst
-		if(addr1Mode == IMMED && mnemonic.opcode == MAPS::opCode["shr"]) {
-			logger("Illegal addressing for shr dst, src line number ",readingLineNumber);
-			returnErrorCode(ERR_SYNTAX);
+		if (operand2.mode == IMMED && instruction.opcode != OP_SHR) {
+			returnErrorCode(ERR_SYNTAX, "Illegal addressing IMMED for dst operand", argument2);
 		}
-		if(addr2Mode == IMMED && mnemonic.opcode != MAPS::opCode["shr"]) {
-			logger("Illegal addressing IMMED for dst operand at line number ",readingLineNumber);
-			returnErrorCode(ERR_SYNTAX);
+		// pc points past the second operand when the first one is read
+		if (operand1.pcRelative) {
+			value1 -= 1 + valueBytes(operand2.mode, instruction);
 		}
+		encodeOperand(operand1, value1, instruction, encoded);
+		encodeOperand(operand2, value2, instruction, encoded);
+		code->append(encoded.bytes, encoded.length);
+	}
+		break;
+	}
+}
 
-		if(isPcRel) {
-			if(addr2Mode == IMMED) {
-					oper1.val += (operandSize) ? -5 : -4;
-			}
-
-			if(addr2Mode == REGIND16B || addr2Mode == MEMDIR) {
-					oper1.val += -5;
+/*
+ * (1) [*|$]0xff[(%r0)], (2) [*|$]label[(%r0)], (3) [*]%r0[l|h], (4) [*](%r0)
+ * out of the text the operand classifier matched, jump - jump syntax, * marks memory
+ */
+void Assembler::parseOperand(std::string_view argument, bool jump, instructionOperand& operand) {
+	stats.counters.operandMatches[matches.type]++;
+	auto match = jump ? Lexer::classifyJumpOperand(argument) : Lexer::classifyInstrOperand(argument);
+	auto text = match.text;
+	operand = { IMMED, 0, 0, match.kind == 2, false, text };
+	switch (match.kind) {
+	case 1:
+	case 2:
+		if (jump ? text[0] != '*' : text[0] == '$') {
+			if (!jump && text.find('(') != std::string_view::npos) {
+				returnErrorCode(ERR_ARGUMENT, operand.symbolic ? "Bad operand format, $symbol(%r<num>)"
+						: "Bad operand format, $literal(%r<num>)", argument);
 			}
-
-			if(addr2Mode == REGDIR || addr2Mode == REGIND) {
-					oper1.val += -3;
+			// a jump takes the whole text as the address
+			if (!jump) {
+				operand.value.remove_prefix(1);
 			}
+			return;
 		}
-
-		machineCode[currentSectionSymbolNumber].push_back(addr1.val);
-
-		if(addr1Mode == IMMED) {
-			if(operandSize) {
-				machineCode[currentSectionSymbolNumber].push_back(oper1.byte1);
-				machineCode[currentSectionSymbolNumber].push_back(oper1.byte2);
-			} else {
-				machineCode[currentSectionSymbolNumber].push_back(oper1.signed8);
-			}
+		if (jump) {
+			text.remove_prefix(1);
 		}
-		if(addr1Mode == REGIND16B || addr1Mode == MEMDIR) {
-			machineCode[currentSectionSymbolNumber].push_back(oper1.byte1);
-			machineCode[currentSectionSymbolNumber].push_back(oper1.byte2);
+		if (auto position = text.find('('); position == std::string_view::npos) {
+			operand.mode = MEMDIR;
+			operand.value = text;
+		} else {
+			auto name = text.substr(position + 2, text.size() - position - 3);
+			operand.mode = REGIND16B;
+			operand.reg = registerCode(name);
+			operand.pcRelative = operand.symbolic && (name == "pc" || name == "r7");
+			operand.value = text.substr(0, position);
 		}
+		return;
+	case 3:
+		text.remove_prefix(jump ? 2 : 1);
+		operand.mode = REGDIR;
+		operand.reg = registerCode(text);
+		operand.part = (text.back() == 'l') ? 0 : 1;
+		return;
+	case 4:
+		text.remove_prefix(jump ? 3 : 2);
+		text.remove_suffix(1);
+		operand.mode = REGIND;
+		operand.reg = registerCode(text);
+		return;
+	}
+	returnErrorCode(ERR_SYNTAX, "Bad operand", argument);
+}
 
-		machineCode[currentSectionSymbolNumber].push_back(addr2.val);
+// value of the operand, numbers are converted and symbols resolved, the location counter moves over the operand
+int16_t Assembler::operandValue(instructionOperand& operand, isaInstruction instruction, std::string_view argument) {
+	auto& isa = ISA[instruction.opcode];
+	if (!operand.symbolic && operand.mode == MEMDIR && isa.operands == 2 && operand.value[0] == '-') {
+		returnErrorCode(ERR_SYNTAX, "Negative address", argument);
+	}
+	locationCounter++;
+	if (operand.mode == REGDIR || operand.mode == REGIND) {
+		return 0;
+	}
+	int16_t value;
+	if (!operand.symbolic) {
+		auto bytes = valueBytes(operand.mode, instruction);
+		value = (bytes == 1) ? toInt8_t(operand.value) : toInt16_t(operand.value);
+		// -Os, 0(%rN) is (%rN); a displacement off pc would change with the size of the instruction
+		if (optimizeSize && operand.mode == REGIND16B && operand.reg != pc && value == 0) {
+			operand.mode = REGIND;
+			stats.counters.relaxedOperands++;
+			stats.counters.relaxedBytes += bytes;
+			return 0;
+		}
+		locationCounter += bytes;
+		return value;
+	}
+	auto symbol = identify(operand.value);
+	// -Os, an .equ displacement the last pass found to be 0 without relocations
+	if (optimizeSize && operand.mode == REGIND16B && !operand.pcRelative) {
+		auto candidate = relaxSymbols.size();
+		relaxSymbols.push_back(symbol);
+		if (relaxStates.size() < relaxSymbols.size()) {
+			relaxStates.push_back(RELAX_LONG);
+		}
+		if (relaxStates[candidate] == RELAX_SHORT) {
+			operand.mode = REGIND;
+			stats.counters.relaxedOperands++;
+			stats.counters.relaxedBytes += 2;
+			return 0;
+		}
+	}
+	if (operand.pcRelative && checkSymbolIsLiteral(symbol)) {
+		// an .equ displacement off pc is taken as it is
+		operand.pcRelative = false;
+		value = autoRelocation(symbol, ADD, isa.jump ? R_16 : LITERAL);
+	} else if (operand.pcRelative) {
+		// pc points past the displacement
+		value = -2 + autoRelocation(symbol, ADD, R_PC16);
+	} else {
+		value = autoRelocation(symbol, ADD, R_16);
+	}
+	// a symbol takes two bytes of the location counter, also as a byte immediate
+	locationCounter += 2;
+	return value;
+}
 
-		if(addr2Mode == IMMED) {
-			if(operandSize) {
-				machineCode[currentSectionSymbolNumber].push_back(oper2.byte1);
-				machineCode[currentSectionSymbolNumber].push_back(oper2.byte2);
-			} else {
-				machineCode[currentSectionSymbolNumber].push_back(oper2.signed8);
-			}
+// a candidate changes at most twice, so the passes end
+bool Assembler::relaxOperands() {
+	auto changed = false;
+	for (uint32_t i = 0; i < relaxSymbols.size(); i++) {
+		auto symbol = relaxSymbols[i];
+		if (relaxStates[i] == RELAX_PINNED) {
+			continue;
 		}
-		if(addr2Mode == REGIND16B || addr2Mode == MEMDIR) {
-			machineCode[currentSectionSymbolNumber].push_back(oper2.byte1);
-			machineCode[currentSectionSymbolNumber].push_back(oper2.byte2);
+		auto zero = false;
+		if (checkSymbolIsLiteral(symbol)) {
+			auto& literal = literals[identifiers[symbol].literal];
+			zero = literal.relocations.empty() && literal.value == 0;
+		}
+		if (relaxStates[i] == RELAX_LONG && zero) {
+			relaxStates[i] = RELAX_SHORT;
+			changed = true;
+		} else if (relaxStates[i] == RELAX_SHORT && !zero) {
+			// a difference of labels that moved apart once the code shrank
+			relaxStates[i] = RELAX_PINNED;
+			changed = true;
 		}
 	}
-		break;
+	return changed;
+}
+
+uint8_t Assembler::valueBytes(uint8_t mode, isaInstruction instruction) {
+	if (mode == IMMED && ISA[instruction.opcode].sized && instruction.size == 0) {
+		return 1;
+	}
+	return OPERAND_VALUE_BYTES[mode];
+}
+
+void Assembler::encodeOperand(const instructionOperand& operand, int16_t value, isaInstruction instruction,
+		encodedInstruction& encoded) {
+	auto byteRegister = operand.mode == REGDIR && ISA[instruction.opcode].sized && instruction.size == 0;
+	encoded.push(operandByte(operand.mode, operand.reg, byteRegister ? operand.part : 0));
+	auto bytes = valueBytes(operand.mode, instruction);
+	if (bytes > 0) {
+		encoded.push(value & 0xff);
+	}
+	if (bytes > 1) {
+		encoded.push((uint16_t)value >> 8);
 	}
 }
 
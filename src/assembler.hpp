@@ -1,16 +1,25 @@
 #ifndef _assembler_hpp_
 #define _assembler_hpp_
 
-#include <regex>
 #include <cstdint>
-#include <unordered_map>
 #include <vector>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
 
 #include "auxiliary.hpp"
+#include "expression.hpp"
+#include "includecache.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "logger.hpp"
+#include "macro.hpp"
+#include "mappedfile.hpp"
+#include "sectioncache.hpp"
+#include "spillfile.hpp"
+#include "stats.hpp"
 
 class Assembler {
 public:
@@ -19,81 +28,232 @@ public:
 
 	void generateObj();
 	void argumentsAnalyzer(int, std::vector<std::string>);
-private:
-	void assemble();
+
+	/*
+	 * Assembles a source held in memory without touching asmFile or objectFile.
+	 * Errors come back as diagnostics, a line with an error is dropped and parsing goes on
+	 * with the next one. The object is reset on every call and can be reused.
+	 */
+	assemblyResult assemble(std::string_view source);
+	void reset();
+
+	/*
+	 * The phases assemble() runs after reset(), in this order. Public for the benchmarks,
+	 * errors are collected in getDiagnostics().
+	 */
+	void parse(std::string_view source);
+	void resolveLiterals();
 	void backpatch();
+	void buildResult(assemblyResult& result);
 
-	struct regexWrapper {
-		std::regex *regex;
-		RegexTypes type;
-	} allTheRegex[numberOfRegex];
+	// errors of the last assembly, in the order they were found
+	const std::vector<diagnostic>& getDiagnostics() const;
+	// file:line:column: error: lines, false if there were none
+	bool printDiagnostics(std::ostream& out) const;
+	// assembly stops after this many errors, 0 - no limit
+	void setMaxErrors(uint32_t limit);
 
-	std::regex operandJumpRegex;
-	std::regex operandInstructionRegex;
+	// off unless argumentsAnalyzer got -l or the caller sets a level and a sink
+	Logger& getLogger();
+	// disabled unless argumentsAnalyzer got --stats or the caller enables it
+	Stats& getStats();
+	// off unless argumentsAnalyzer got --cache or the caller opens a directory
+	SectionCache& getCache();
+	/*
+	 * Off unless argumentsAnalyzer got --spill or the caller opens a directory. While it is open every
+	 * finished section moves there and assemble() leaves its bytes out of the result.
+	 */
+	SpillFile& getSpill();
+	// .include searches the directory of the including file, then these in order (-I)
+	void setIncludePaths(std::vector<std::string> paths);
+	// for diagnostics and relative includes, argumentsAnalyzer sets it from the source argument
+	void setSourcePath(std::string path);
+	/*
+	 * -Os: a zero displacement off a general register is encoded as register indirect, for an .equ
+	 * assemble() runs the pass again once its value is known. Off by default, --cache isn't used while it is on.
+	 */
+	void setOptimizeSize(bool on);
+private:
+	// all of reset() but the stats
+	void resetPass();
+	void pass(std::string_view source, assemblyResult& result);
 
-	std::smatch matches;
-	std::smatch operandType;
+	lineMatch matches;
 
 	uint16_t locationCounter;
-	std::string readLine;
+	std::string_view readLine;
 	int readingLineNumber;
 	bool foundEnd;
-	std::string currentSection;
-	uint8_t currentSectionSymbolNumber;
-	uint8_t symbolNumber;
+	uint32_t currentSection;
+	uint32_t currentSectionSymbolNumber;
+	uint32_t currentSectionIndex;
+	uint32_t symbolNumber;
 
-	std::fstream logFile;
+	Logger logger;
+	Stats stats;
+	std::vector<diagnostic> diagnostics;
+	uint32_t maxErrors = 20;
+	bool stopped;	// maxErrors reached
+	std::string statsPath;
+	std::string sourcePath;
 	std::fstream objectFile;
-	std::fstream asmFile;
+	int objectFormat;
+	MappedFile asmFile;
 
-	std::unordered_map<std::string, symbolTableEntry> symbolTable;
-	std::unordered_map<std::string, sectionEntry> sectionTable;
-	std::unordered_map<uint8_t, std::string> sectionTranslation;
-	std::unordered_map<std::string, std::vector<relocationEntry>> relocationTable;
+	// every name is interned once, the tables below are indexed by its ID
+	Interner names;
+	std::vector<identifierEntry> identifiers;
+	uint64_t openBackpatches;	// backpatch entries not yet applied, over all identifiers
+	std::vector<literalEntry> literals;
+	std::vector<compiledLiteral> compiledLiterals;	// by literal index
+	std::vector<expressionToken> expressionCode;
+	std::vector<std::string_view> expressionNames;	// scratch for Expression::compile
+	std::vector<uint32_t> literalStack;
+	std::vector<std::pair<int32_t, uint32_t>> evaluationStack;	// value, its first relocation
+	// chunks of every section buffer, declared before sections so it outlives them
+	ChunkArena codeArena;
+	// in order of definition, 0 - UNDEFINED
+	std::vector<sectionEntry> sections;
+	// section symbol number -> index into sections
+	std::vector<uint32_t> sectionIndex;
+	std::vector<relocationEntry> relocationScratch;	// for sorting a relocation table
+	// buffer of the current section, moves when a section is added
+	SectionBuffer *code;
+	// finished sections, code memory stays at one section however long the source is
+	SpillFile spill;
 
-	std::unordered_map<std::string, literalEntry> literalTable;
+	/*
+	 * -Os: 0(%rN) is encoded as (%rN) as it is read. An .equ displacement, symbol(%rN), is known only
+	 * after the pass, it is dropped in the next pass if this one evaluated the .equ to 0 without relocations,
+	 * and kept for good if the .equ stops being 0 once the code around it shrank.
+	 */
+	static constexpr uint8_t RELAX_LONG = 0, RELAX_SHORT = 1, RELAX_PINNED = 2;
+	bool optimizeSize = false;
+	std::vector<uint8_t> relaxStates;	// by candidate, the same operands come in the same order every pass
+	std::vector<uint32_t> relaxSymbols;	// .equ of every candidate of the current pass
+	// false if no operand changes size in the next pass
+	bool relaxOperands();
 
-	std::unordered_map<std::string, std::vector<backpatchInfo>> TII;
+	/*
+	 * Section bodies, the lines between two section lines, are looked up in the cache by text.
+	 * A body that isn't there is encoded while every identifier it looks up is recorded
+	 * with its state before, and stored when it ends without errors.
+	 */
+	SectionCache cache;
+	cachedSection cacheEntry;
+	bool recording;
+	size_t recordEnd;	// source offset the body ends at
+	int recordLine;	// of the section line
+	size_t recordErrors;
+	uint32_t recordGeneration = 0;
+	std::vector<uint32_t> recordStamp;	// generation of the body that last recorded the identifier
+	std::vector<uint32_t> recordIds;	// cacheEntry.names order
+	std::vector<size_t> recordBackpatch;	// backpatch entries the identifier had before the body
+	uint64_t recordLineTypes[numberOfRegex];	// stats.counters.lineTypes before the body
 
-	std::unordered_map<uint8_t, std::vector<uint8_t>> machineCode;
+	/*
+	 * A .macro or .rept body is collected up to .endm/.endr and classified once, an expansion only
+	 * substitutes the arguments into the classified lines. Labels defined in a body get the suffix
+	 * __<expansion number>.
+	 */
+	static constexpr uint8_t BLOCK_NONE = 0, BLOCK_MACRO = 1, BLOCK_REPT = 2;
+	static constexpr uint32_t MAX_EXPANSION_DEPTH = 64;
+	Interner macroNames;
+	std::vector<macroDefinition> macros;	// by macroNames ID
+	uint64_t macroHash;	// of all definitions so far, cached section bodies depend on it
+	uint8_t defining;
+	int blockLine;	// of the .macro or .rept line
+	const char *blockStart;
+	std::string_view blockName;
+	std::vector<std::string_view> blockParameters;
+	std::vector<std::string_view> blockLines;
+	uint16_t blockCount;
+	uint32_t expansions;
+	uint32_t expansionDepth;
+	std::vector<std::string> expansionBuffers;	// one per depth, lines of an expansion are built in it
 
-	bool checkSymbolExists(std::string);
-	bool checkSymbolIsLiteral(std::string);
-	bool checkSymbolIsExtern(std::string);
-	bool checkSymbolIsGlobal(std::string);
-	bool checkSymbolIsDefined(std::string);
+	// included files are replayed from the lexed lines IncludeCache keeps
+	static constexpr uint32_t MAX_INCLUDE_DEPTH = 16;
+	std::vector<std::string> includePaths;
+	std::vector<std::string> sourceFiles;	// of the included files in order of inclusion, 0 - the source
+	uint32_t currentFile;	// sourceFiles index of readLine
+	std::vector<std::string> includeStack;
 
-	void defineLabel(std::string);
-	void addUndefinedSymbol(std::string);
-	void addNewLabel(std::string);
-	void addGlobal(std::string);
-	void addExtern(std::string);
+	uint32_t identify(std::string_view name);
+	std::string sectionName(uint32_t number);
+	sectionEntry& section(uint32_t number);
+	void spillSection();
+	void patchCode(sectionEntry& target, uint16_t offset, int32_t value, uint8_t size);
+
+	bool checkSymbolExists(uint32_t);
+	bool checkSymbolIsLiteral(uint32_t);
+	bool checkSymbolIsExtern(uint32_t);
+	bool checkSymbolIsGlobal(uint32_t);
+	bool checkSymbolIsDefined(uint32_t);
+
+	void addSymbol(uint32_t, symbolTableEntry);
+	void defineLabel(uint32_t);
+	void addBackpatch(uint32_t symbol, const backpatchInfo& entry);
+	void addUndefinedSymbol(uint32_t);
+	void addNewLabel(uint32_t);
+	void addGlobal(std::string_view);
+	void addExtern(std::string_view);
 
 	void checkSection();
+	void fill(uint8_t value, uint32_t count);
 
-	void calculateLiteral(std::string);
-	void calculateExpression(std::string, char, std::string);
+	void resolveLiteral(uint32_t literal);
+	void evaluateLiteral(uint32_t literal);
+	// value of a symbol term, its relocations are appended
+	int32_t termValue(uint32_t symbol, uint32_t literal, std::vector<relocationInfo>& relocations);
 
-	int8_t toInt8_t(std::string);
-	int16_t toInt16_t(std::string);
+	int8_t toInt8_t(std::string_view);
+	int16_t toInt16_t(std::string_view);
+	uint16_t toCount(std::string_view);
 
-	void resolveSymbol(std::string);
-	int autoRelocation(std::string, char, std::string);
+	void resolveSymbol(std::string_view);
+	int autoRelocation(uint32_t, char, uint8_t relocationType);
 
-	void createRelocation(uint8_t, std::string, char);
-	void createBackpatchEntry(std::string, char, uint8_t, std::string relocationType);
+	void createRelocation(uint32_t, uint8_t, char);
+	void createBackpatchEntry(uint32_t, char, uint8_t, uint8_t relocationType);
 
-	void regexInit();
-	void validateRegex();
+	void validateRegex(std::string_view line);
+	void encodeLine();
 	void decypherRegex(int);
+	// one instruction operand, the text keeps pointing into the line
+	void parseOperand(std::string_view argument, bool jump, instructionOperand& operand);
+	int16_t operandValue(instructionOperand& operand, isaInstruction instruction, std::string_view argument);
+	uint8_t valueBytes(uint8_t mode, isaInstruction instruction);
+	void encodeOperand(const instructionOperand& operand, int16_t value, isaInstruction instruction,
+			encodedInstruction& encoded);
+
+	// false if the line isn't part of the block being defined
+	bool blockBody();
+	void finishBlock();
+	// false if the line isn't an invocation of a defined macro
+	bool expandInvocation(std::string_view line);
+	void expand(const macroDefinition& definition, const std::vector<std::string_view>& arguments);
+	void include(std::string_view name);
+	// empty if the file is in none of the directories
+	std::string findInclude(std::string_view name);
+
+	void returnErrorCode(int err, std::string message, std::string_view at = std::string_view());
+	// records a diagnostic, false once maxErrors is reached
+	bool recover(const AssemblyError& error);
+	void backpatchEntry(uint32_t symbol, const backpatchInfo& entry);
 
-	void logger(std::string);
-	void logger(std::string s, int i);
+	size_t sectionBody(std::string_view source, size_t position);
+	void recordIdentifier(uint32_t id);
+	bool replaySection(const cachedSection& entry);
+	void storeSection();
 
-	template <typename T>
-	void printElement(T t);
+	void collectStats(const assemblyResult& result);
+	void writeStats(bool success);
 
-	std::string get(uint8_t);
+	// views into readLine, valid until the next line is read
+	std::string_view get(uint8_t);
+	// scratch for parserComma, keeps its capacity across lines
+	std::vector<std::string_view> listItems;
 };
 
 #endif
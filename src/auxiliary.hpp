@@ -3,22 +3,44 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+
+#include "sectionbuffer.hpp"
 
 //EXIT CODES
 static constexpr auto ERR_OK = 0, ERR_FOPEN = 1, ERR_ARGUMENT = 2, ERR_SYNTAX = 3,
 		ERR_SECTION = 4, ERR_MULTIPLE_DEFINITIONS = 5, ERR_REDEFINITION = 6, ERR_PCREL_ARG = 7, ERR_INVALID_OPERAND = 8,
 		ERR_UNDEFINED_SYMBOL = 9;
 
+// Thrown in place of exiting, carries one of the exit codes above
+class AssemblyError {
+public:
+	AssemblyError(int code, int line = 0, std::string message = "", int column = 0)
+			: code(code), line(line), column(column), message(message) {}
+	int code;
+	int line;	// 0 when the error isn't tied to a source line
+	int column;	// 1 based, 0 when unknown
+	std::string message;
+};
+
 static constexpr auto UNDEFINED_SECTION = 0;
 
-static constexpr auto ADD = '+', SUB = '-';
+// section flags, a nobits section (.bss) only reserves its size
+static constexpr uint16_t SECTION_NOBITS = 1;
+// .skip and the .align default
+static constexpr uint8_t SKIP_FILL = 0x90;
+
+// symbolTableEntry type and symbolType
+static constexpr uint8_t SYM_LOCAL = 0, SYM_GLOBAL = 1, SYM_EXTERN = 2;
+static constexpr uint8_t SYM_LABEL = 0, SYM_SECTION = 1;
 
-static constexpr auto R_16 = "R_16", R_PC16 = "R_PC16", LITERAL = "LITERAL";
+static constexpr auto ADD = '+', SUB = '-';
 
-static constexpr auto IMMED = "immed", REGDIR = "regdir", REGIND = "regind",
-		REGIND16B = "regind16b", MEMDIR = "memdir";
+// relocation types, a backpatch entry of an .equ symbol is LITERAL
+static constexpr uint8_t R_16 = 0, R_PC16 = 1, LITERAL = 2;
+// by type, as the text object and the log print them
+extern const char *relocationTypeNames[3];
 
 static constexpr uint8_t r0 = 0x0, r1 = 0x1, r2 = 0x2, r3 = 0x3, r4 = 0x4, r5 = 0x5,
 		r6 = 0x6, sp = 0x6, r7 = 0x7, pc = 0x7, psw = 0xf;
@@ -28,47 +50,15 @@ static constexpr auto INT16_T_MIN = -32768;
 static constexpr auto INT8_T_MAX = 127;
 static constexpr auto INT8_T_MIN = -128;
 
-class MAPS {
-public:
-	static std::unordered_map<std::string, uint8_t> regs;
-
-	static std::unordered_map<std::string, uint8_t> opCode;
-
-	static std::unordered_map<std::string, uint8_t> operandSize;
-
-	static std::unordered_map<std::string, uint8_t> addressingMode;
-};
-
-// First byte of an instruction (operation code :5, operand size [1 or 2 bytes]:1 , unused :2)
-union Mnemonics {
-	struct {
-		uint8_t val;
-	};
-	struct {
-		uint8_t :2, size :1, opcode :5;
-	};
-};
-// Second byte (addressing type :3, )
-union Addressing {
-	struct {
-		uint8_t val;
-	};
-	struct {
-		uint8_t part :1, regs :4, addressMode :3;
-	};
-};
+// bytes of one instruction, appended to the section at once
+typedef struct {
+	uint8_t bytes[8];
+	uint8_t length = 0;
 
-union ImmedValues {
-	struct {
-		int16_t val;
-	};
-	struct {
-		uint8_t signed8;
-	};
-	struct {
-		uint8_t byte1, byte2; //byte1 - nizi; byte2 - visi
-	};
-};
+	void push(uint8_t byte) {
+		bytes[length++] = byte;
+	}
+} encodedInstruction;
 
 enum RegexTypes {
 	/*0*/regexComment,               // 1: #komentar
@@ -93,80 +83,163 @@ enum RegexTypes {
 	/*10*/
 	regexInstrOneOperand,       // 1: [labela] 2: instr 3: literal, simbol
 	/*11*/
-	regexInstrTwoOperand // 1: [labela] 2: instr 3: izraz operanda / registar kod regdir 4: '[' 5: registar 6:']' 7: [izraz pomeraja] 8: izraz operanda / registar kod regdir 9: '[' a: registar b: ']' c: [izraz pomeraja]
+	regexInstrTwoOperand, // 1: [labela] 2: instr 3: izraz operanda / registar kod regdir 4: '[' 5: registar 6:']' 7: [izraz pomeraja] 8: izraz operanda / registar kod regdir 9: '[' a: registar b: ']' c: [izraz pomeraja]
+	/*12*/
+	regexAlign,                 // 1: [labela] 2: poravnanje[,vrednost]
+	/*13*/
+	regexFill,                  // 1: [labela] 2: broj,velicina,vrednost
+	/*14*/
+	regexZero,                  // 1: [labela] 2: koliko nula bajtova
+	/*15*/
+	regexMacro,                 // 1: naziv makroa 2: [parametri odvojeni zarezom]
+	/*16*/
+	regexEndm,                  // kraj makroa
+	/*17*/
+	regexRept,                  // 1: [labela] 2: broj ponavljanja
+	/*18*/
+	regexEndr,                  // kraj ponavljanja
+	/*19*/
+	regexInclude                // 1: putanja fajla
 };
 
-constexpr uint8_t numberOfRegex = 12;
+constexpr uint8_t numberOfRegex = 20;
 
 constexpr uint8_t LABEL = 1, SECTION = 1, SYMBOL = 1, EXPRESSION = 2,    // .equ
 		LIST = 2,           //.byte .word .skip
 		OPERATION = 2, ARG1 = 3, ARG2 = 4;
 
 /*  std::string symbolName;   ulaz u hashmapu
- uint8_t number;     // symbol number
- uint8_t sectionNumber;  // broj sekcije u kojoj se nalazi, iskoristi u tabeli relokacija
+ uint32_t number;     // symbol number
+ uint32_t sectionNumber;  // broj sekcije u kojoj se nalazi, iskoristi u tabeli relokacija
  uint16_t offset;    // 0 for section
- std::string type; // global, local, extern
+ uint8_t type; // SYM_LOCAL, SYM_GLOBAL, SYM_EXTERN
  uint16_t size;  // 0 for label
- std::string symbolType;   // label, section
+ uint8_t symbolType;   // SYM_LABEL, SYM_SECTION
  */
 typedef struct {
-	uint8_t number;
-	uint8_t sectionNumber;
+	uint32_t number;
+	uint32_t sectionNumber;
 	uint16_t offset;
-	std::string type;
+	uint8_t type;
 	uint16_t size;
-	std::string symbolType;
+	uint8_t symbolType;
 } symbolTableEntry;
 
-/*  std::string sectionName; ulaz u hashmapu
- uint16_t sectionSize;
- uint8_t number;
- */
-typedef struct {
-	uint16_t sectionSize;
-	uint8_t number;
-} sectionEntry;
-
 typedef struct {
 	char operation;
 	std::string symbol;
 } expressionStruct;
 
 typedef struct {
-	uint8_t sectionNumber;
+	uint32_t sectionNumber;
 	uint16_t offset;
 	char action;
 	uint8_t size;   //number of bytes 1 or 2
-	std::string relocationType;
+	uint8_t relocationType;
+	uint32_t line;	// source line of the reference, for diagnostics
+	uint32_t file;	// of the line, 0 - the source being assembled
 } backpatchInfo;
 
 // Tabela relokacija
 typedef struct {
 	uint16_t offset;
-	std::string type;   // "R_16" ili "R_PC16" za skokove
+	uint8_t type;   // R_16 ili R_PC16 za skokove
 	char op;     		// "+" or "-"
-	uint8_t value;      // section/symbol number
+	uint32_t value;      // section/symbol number
 } relocationEntry;
 
+static_assert(sizeof(relocationEntry) == 8, "relocation layout");
+
 typedef struct {
-	uint8_t symbolNumber;
+	uint32_t symbolNumber;
 	char op;
-	std::string type;
+	uint8_t type;
 } relocationInfo;
 
 typedef struct {
 	std::string expression;
 	int16_t value;
 	std::vector<relocationInfo> relocations;
+	uint32_t line;	// source line of the .equ, 0 when read from an object
+	uint32_t file;
 } literalEntry;
 
-std::vector<std::string> parserComma(std::string str);
+static constexpr uint8_t ID_NONE = 0, ID_SYMBOL = 1, ID_LITERAL = 2;
+
+// Everything known about one interned name, symbol or literal depending on kind
+typedef struct {
+	uint8_t kind;
+	symbolTableEntry symbol;
+	uint32_t literal;	// index into the literal table
+	std::vector<backpatchInfo> backpatch;	// forward references, applied when the label is defined or after parsing
+} identifierEntry;
+
+typedef struct {
+	uint32_t name;	// identifier ID
+	uint32_t number;	// section symbol number
+	uint16_t sectionSize;
+	SectionBuffer code;
+	std::vector<relocationEntry> relocations;
+	uint16_t flags;
+	bool spilled;	// the stored bytes are in the spill file (asm --spill), code keeps only the runs
+	uint64_t spillOffset;
+	uint32_t spillSize;
+} sectionEntry;
+
+/*
+ * Assembled object, the tables generateObj prints in the order it prints them
+ */
+typedef struct {
+	std::string name;
+	std::string section;
+	symbolTableEntry entry;
+} objectSymbol;
+
+typedef struct {
+	std::string name;
+	literalEntry entry;
+} objectLiteral;
+
+typedef struct {
+	std::string section;
+	std::vector<relocationEntry> relocations;
+} objectRelocations;
+
+typedef struct {
+	std::string name;
+	uint32_t number;
+	uint16_t size;
+	std::vector<uint8_t> bytes;	// without the fill runs
+	std::vector<fillRun> fills;
+	uint16_t flags;	// SECTION_NOBITS - only the size is kept
+} objectSection;
+
+typedef struct {
+	int line;	// 0 - not tied to a line
+	int column;	// 0 - unknown
+	int code;
+	std::string message;
+	std::string file;	// included file the line is in, empty - the source
+} diagnostic;
+
+typedef struct {
+	bool success;
+	std::vector<objectSymbol> symbols;
+	std::vector<objectLiteral> literals;
+	std::vector<objectRelocations> relocations;
+	std::vector<objectSection> sections;
+	std::vector<diagnostic> diagnostics;
+	bool truncated;	// stopped at the error limit, there may be more
+} assemblyResult;
+
+// source:line:column: error: message, the parts that are known
+std::string formatDiagnostic(std::string_view source, const diagnostic& error);
+
+// splits a comma list into views of str, empty items are skipped, items is cleared first
+void parserComma(std::string_view str, std::vector<std::string_view>& items);
 
 int16_t toInt16_t(std::string str);
 
 int8_t toInt8_t(std::string str);
 
-bool isJump(std::string i);
-
 #endif
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "assembler.hpp"
+#include "batch.hpp"
+
+Batch::Batch(unsigned workers, std::string format, std::string logLevel) : nextJob(0), workers(workers), format(format),
+		logLevel(logLevel) {
+	if (this->workers == 0) {
+		this->workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+void Batch::addJob(std::string source, std::string object) {
+	if (object == "") {
+		object = source;
+		if (object.size() > 2 && object.compare(object.size() - 2, 2, ".s") == 0) {
+			object.erase(object.size() - 2);
+		}
+		object += ".o";
+	}
+	jobs.push_back( { source, object });
+}
+
+bool Batch::addArgument(std::string argument) {
+	if (argument[0] == '@') {
+		return addResponseFile(argument.substr(1));
+	}
+	addJob(argument, "");
+	return true;
+}
+
+void Batch::addIncludePath(std::string path) {
+	includePaths.push_back(path);
+}
+
+bool Batch::addResponseFile(std::string path) {
+	std::ifstream list(path);
+	if (!list.good()) {
+		std::cerr << "Unable to open response file " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	auto lineNumber = 0;
+	while (std::getline(list, line)) {
+		++lineNumber;
+		std::stringstream parser(line);
+		std::string source, option, object, rest;
+		parser >> source >> option >> object >> rest;
+		if (source == "" || source[0] == '#') {
+			continue;
+		}
+		if (rest != "" || (option != "" && (option != "-o" || object == ""))) {
+			std::cerr << path << ":" << lineNumber << ": expected src.s [-o obj.o]" << std::endl;
+			return false;
+		}
+		addJob(source, object);
+	}
+	return true;
+}
+
+int Batch::assembleJob(const batchJob& job, std::string& messages) {
+	Assembler assembler;
+	try {
+		std::vector<std::string> args { job.source, "-o", job.object, "-f", format, "-l", logLevel, "-L", job.object + ".log" };
+		for (auto& path : includePaths) {
+			args.push_back("-I");
+			args.push_back(path);
+		}
+		assembler.argumentsAnalyzer(args.size(), args);
+		assembler.generateObj();
+	} catch (AssemblyError& error) {
+		std::stringstream text;
+		if (!assembler.printDiagnostics(text)) {
+			text << job.source << ": error: " << error.message << '\n';
+		}
+		messages = text.str();
+		return error.code;
+	}
+	return ERR_OK;
+}
+
+void Batch::worker() {
+	for (auto i = nextJob++; i < jobs.size(); i = nextJob++) {
+		results[i] = assembleJob(jobs[i], messages[i]);
+	}
+}
+
+int Batch::run() {
+	results.assign(jobs.size(), ERR_OK);
+	messages.assign(jobs.size(), std::string());
+	std::vector<std::thread> pool;
+	auto threads = std::min<size_t>(workers, jobs.size());
+	for (size_t i = 0; i < threads; i++) {
+		pool.emplace_back(&Batch::worker, this);
+	}
+	for (auto& thread : pool) {
+		thread.join();
+	}
+
+	auto status = ERR_OK;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (results[i] != ERR_OK) {
+			std::cerr << messages[i] << jobs[i].source << ": error code " << results[i] << std::endl;
+			if (status == ERR_OK) {
+				status = results[i];
+			}
+		}
+	}
+	return status;
+}
@@ -0,0 +1,45 @@
+#ifndef _batch_hpp_
+#define _batch_hpp_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+typedef struct {
+	std::string source;
+	std::string object;
+} batchJob;
+
+/*
+ * Assembles many source files on a pool of worker threads.
+ * Every job gets its own Assembler object, jobs share nothing but the read-only ISA tables
+ * and the included files IncludeCache lexed.
+ */
+class Batch {
+public:
+	// logLevel other than off writes a log per job next to its object (obj.o.log)
+	Batch(unsigned workers, std::string format, std::string logLevel = "off");
+
+	// src.s or @list, list holds one "src.s [-o obj.o]" per line
+	bool addArgument(std::string argument);
+	// -I, searched by .include in every job
+	void addIncludePath(std::string path);
+	int run();
+private:
+	bool addResponseFile(std::string path);
+	void addJob(std::string source, std::string object);
+	void worker();
+	// diagnostics of a failed job are formatted into messages
+	int assembleJob(const batchJob& job, std::string& messages);
+
+	std::vector<batchJob> jobs;
+	std::vector<int> results;
+	std::vector<std::string> messages;
+	std::atomic<size_t> nextJob;
+	unsigned workers;
+	std::string format;
+	std::string logLevel;
+	std::vector<std::string> includePaths;
+};
+
+#endif
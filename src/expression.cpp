@@ -0,0 +1,244 @@
+#include "expression.hpp"
+
+namespace {
+
+constexpr uint32_t MAX_NESTING = 64;
+
+inline bool isIdentifierChar(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+// recursive descent, one function per precedence level, tokens are emitted in RPN order
+class Parser {
+public:
+	Parser(std::string_view text, std::vector<expressionToken>& code, std::vector<std::string_view>& names)
+			: text(text), code(code), names(names) {}
+
+	bool parse() {
+		return alternation() && (skipBlank(), position == text.size() || fail("Unexpected character in expression"));
+	}
+
+	size_t errorAt = 0;
+	std::string error;
+private:
+	bool fail(const char *message) {
+		if (error.empty()) {
+			errorAt = position;
+			error = message;
+		}
+		return false;
+	}
+
+	void skipBlank() {
+		while (position < text.size() && (text[position] == ' ' || text[position] == '\t')) {
+			position++;
+		}
+	}
+
+	// the next operator, consumed if it is op
+	bool accept(std::string_view op) {
+		skipBlank();
+		if (text.compare(position, op.size(), op) != 0) {
+			return false;
+		}
+		position += op.size();
+		return true;
+	}
+
+	void emit(uint8_t kind, uint32_t offset, int32_t value = 0) {
+		code.push_back( { kind, offset, value });
+	}
+
+	bool alternation() {
+		if (!conjunction()) {
+			return false;
+		}
+		while (true) {
+			auto offset = (skipBlank(), position);
+			if (!accept("|")) {
+				return true;
+			}
+			if (!conjunction()) {
+				return false;
+			}
+			emit(EXPR_OR, offset);
+		}
+	}
+
+	bool conjunction() {
+		if (!shift()) {
+			return false;
+		}
+		while (true) {
+			auto offset = (skipBlank(), position);
+			if (!accept("&")) {
+				return true;
+			}
+			if (!shift()) {
+				return false;
+			}
+			emit(EXPR_AND, offset);
+		}
+	}
+
+	bool shift() {
+		if (!additive()) {
+			return false;
+		}
+		while (true) {
+			auto offset = (skipBlank(), position);
+			uint8_t kind;
+			if (accept("<<")) {
+				kind = EXPR_SHL;
+			} else if (accept(">>")) {
+				kind = EXPR_SHR;
+			} else {
+				return true;
+			}
+			if (!additive()) {
+				return false;
+			}
+			emit(kind, offset);
+		}
+	}
+
+	bool additive() {
+		if (!multiplicative()) {
+			return false;
+		}
+		while (true) {
+			auto offset = (skipBlank(), position);
+			uint8_t kind;
+			if (accept("+")) {
+				kind = EXPR_ADD;
+			} else if (accept("-")) {
+				kind = EXPR_SUB;
+			} else {
+				return true;
+			}
+			if (!multiplicative()) {
+				return false;
+			}
+			emit(kind, offset);
+		}
+	}
+
+	bool multiplicative() {
+		if (!unary()) {
+			return false;
+		}
+		while (true) {
+			auto offset = (skipBlank(), position);
+			uint8_t kind;
+			if (accept("*")) {
+				kind = EXPR_MUL;
+			} else if (accept("/")) {
+				kind = EXPR_DIV;
+			} else {
+				return true;
+			}
+			if (!unary()) {
+				return false;
+			}
+			emit(kind, offset);
+		}
+	}
+
+	bool unary() {
+		auto offset = (skipBlank(), position);
+		if (accept("-")) {
+			if (++depth > MAX_NESTING || !unary()) {
+				return fail("Expression nested too deep");
+			}
+			depth--;
+			emit(EXPR_NEGATE, offset);
+			return true;
+		}
+		if (accept("+")) {
+			if (++depth > MAX_NESTING || !unary()) {
+				return fail("Expression nested too deep");
+			}
+			depth--;
+			return true;
+		}
+		return primary();
+	}
+
+	bool primary() {
+		skipBlank();
+		auto offset = position;
+		if (accept("(")) {
+			if (++depth > MAX_NESTING) {
+				return fail("Expression nested too deep");
+			}
+			if (!alternation()) {
+				return false;
+			}
+			depth--;
+			return accept(")") || fail("Missing ) in expression");
+		}
+		auto end = position;
+		while (end < text.size() && isIdentifierChar(text[end])) {
+			end++;
+		}
+		if (end == position) {
+			return fail("Expected a number or a symbol");
+		}
+		auto term = text.substr(position, end - position);
+		position = end;
+		if (term[0] >= '0' && term[0] <= '9') {
+			int32_t value;
+			if (!number(term, value)) {
+				position = offset;
+				return fail("Invalid number in expression");
+			}
+			emit(EXPR_NUMBER, offset, value);
+			return true;
+		}
+		emit(EXPR_SYMBOL, offset, names.size());
+		names.push_back(term);
+		return true;
+	}
+
+	// 0x, 0b, 0o prefixed or decimal, at most 0xffff like the other number forms
+	static bool number(std::string_view term, int32_t& value) {
+		uint32_t radix = 10;
+		if (term.size() > 2 && term[0] == '0' && (term[1] == 'x' || term[1] == 'b' || term[1] == 'o')) {
+			radix = (term[1] == 'x') ? 16 : (term[1] == 'b') ? 2 : 8;
+			term.remove_prefix(2);
+		}
+		uint32_t result = 0;
+		for (auto ch : term) {
+			uint32_t digit = (ch >= '0' && ch <= '9') ? ch - '0' : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10
+					: (ch >= 'A' && ch <= 'F') ? ch - 'A' + 10 : radix;
+			if (digit >= radix) {
+				return false;
+			}
+			result = result * radix + digit;
+			if (result > 65535) {
+				return false;
+			}
+		}
+		value = result;
+		return true;
+	}
+
+	std::string_view text;
+	std::vector<expressionToken>& code;
+	std::vector<std::string_view>& names;
+	size_t position = 0;
+	uint32_t depth = 0;
+};
+
+}
+
+bool Expression::compile(std::string_view text, std::vector<expressionToken>& code, std::vector<std::string_view>& names,
+		size_t& errorAt, std::string& error) {
+	Parser parser(text, code, names);
+	if (!parser.parse()) {
+		errorAt = parser.errorAt;
+		error = parser.error;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef _expression_hpp_
+#define _expression_hpp_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// operations of a compiled expression, EXPR_NUMBER and EXPR_SYMBOL push a term
+static constexpr uint8_t EXPR_NUMBER = 0, EXPR_SYMBOL = 1, EXPR_NEGATE = 2, EXPR_ADD = 3, EXPR_SUB = 4, EXPR_MUL = 5,
+		EXPR_DIV = 6, EXPR_AND = 7, EXPR_OR = 8, EXPR_SHL = 9, EXPR_SHR = 10;
+
+typedef struct {
+	uint8_t kind;
+	uint32_t offset;	// in the expression text, for diagnostics
+	int32_t value;	// EXPR_NUMBER - the number, EXPR_SYMBOL - index into the compiled names
+} expressionToken;
+
+static constexpr uint8_t LITERAL_PENDING = 0, LITERAL_ACTIVE = 1, LITERAL_DONE = 2;
+
+// .equ literal as compiled at its line, literals are evaluated after every literal they refer to
+typedef struct {
+	uint32_t name;	// identifier ID of the .equ symbol
+	uint32_t start, length;	// tokens in the compiled code, symbol tokens hold identifier IDs
+	uint8_t state;	// LITERAL_ACTIVE - being evaluated, a literal referring to it is circular
+} compiledLiteral;
+
+/*
+ * .equ expressions: numbers, symbols, unary -, * /, + -, << >>, &, | from the tightest binding,
+ * and parentheses. An expression is parsed once into RPN, evaluating it is a single pass over the tokens.
+ */
+class Expression {
+public:
+	/*
+	 * Appends the RPN of text to code and the symbol names it refers to to names.
+	 * False with the offset into text and a message if text isn't an expression.
+	 */
+	static bool compile(std::string_view text, std::vector<expressionToken>& code, std::vector<std::string_view>& names,
+			size_t& errorAt, std::string& error);
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include <sys/stat.h>
+
+#include "includecache.hpp"
+#include "mappedfile.hpp"
+
+IncludeCache& IncludeCache::shared() {
+	static IncludeCache cache;
+	return cache;
+}
+
+static bool fileStamp(const std::string& path, int64_t& modified, uint64_t& size) {
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+		return false;
+	}
+	modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+	size = status.st_size;
+	return true;
+}
+
+std::shared_ptr<const includedFile> IncludeCache::get(const std::string& path, bool& hit) {
+	int64_t modified;
+	uint64_t size;
+	hit = false;
+	if (!fileStamp(path, modified, size)) {
+		return nullptr;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto found = files.find(path);
+		if (found != files.end() && found->second->modified == modified && found->second->size == size) {
+			hit = true;
+			return found->second;
+		}
+	}
+
+	// lexed outside the lock, two threads missing the same file both lex it
+	auto file = lex(path);
+	if (!file) {
+		return nullptr;
+	}
+	file->modified = modified;
+	file->size = size;
+	std::lock_guard<std::mutex> guard(lock);
+	files[path] = file;
+	return file;
+}
+
+std::shared_ptr<includedFile> IncludeCache::lex(const std::string& path) {
+	MappedFile mapped;
+	if (!mapped.open(path)) {
+		return nullptr;
+	}
+	auto file = std::make_shared<includedFile>();
+	file->path = path;
+	file->text = std::string(mapped.text());
+	std::string_view text = file->text;
+	lineMatch match;
+	size_t position = 0;
+	while (position < text.size()) {
+		auto end = text.find('\n', position);
+		if (end == std::string_view::npos) {
+			end = text.size();
+		}
+		auto line = text.substr(position, end - position);
+		includedLine entry { (uint32_t)position, (uint32_t)line.size(), UNCLASSIFIED, { }, { }, { } };
+		if (Lexer::classify(line, match)) {
+			entry.type = match.type;
+			entry.instruction = match.instruction;
+			for (uint8_t g = 0; g < 5; g++) {
+				if (!match.group[g].empty()) {
+					entry.groupOffset[g] = match.group[g].data() - text.data();
+					entry.groupLength[g] = match.group[g].size();
+				}
+			}
+		}
+		file->lines.push_back(entry);
+		position = end + 1;
+	}
+	return file;
+}
@@ -0,0 +1,49 @@
+#ifndef _includecache_hpp_
+#define _includecache_hpp_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lexer.hpp"
+
+// one line of an included file as the lexer saw it, groups are offsets into the file text
+typedef struct {
+	uint32_t offset, length;
+	RegexTypes type;	// UNCLASSIFIED - macro invocations and bad lines, classified again when replayed
+	isaInstruction instruction;
+	uint32_t groupOffset[5];
+	uint32_t groupLength[5];
+} includedLine;
+
+typedef struct {
+	std::string path;
+	int64_t modified;	// st_mtim in ns
+	uint64_t size;
+	std::string text;
+	std::vector<includedLine> lines;	// every line, line i + 1 of the file is lines[i]
+} includedFile;
+
+/*
+ * Included files lexed once per process and shared by all Assembler objects, the batch jobs and
+ * the server workers alike. A file is lexed again when its modification time or size changes,
+ * a replaced file doesn't disturb assemblies still holding the old one.
+ */
+class IncludeCache {
+public:
+	static IncludeCache& shared();
+
+	// null if the file can't be read, hit - it was lexed before
+	std::shared_ptr<const includedFile> get(const std::string& path, bool& hit);
+private:
+	static std::shared_ptr<includedFile> lex(const std::string& path);
+
+	std::mutex lock;
+	std::unordered_map<std::string, std::shared_ptr<const includedFile>> files;
+};
+
+#endif
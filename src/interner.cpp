@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cstring>
+
+#include "interner.hpp"
+
+// FNV-1a
+uint32_t Interner::hash(std::string_view name) {
+	uint32_t h = 2166136261u;
+	for (unsigned char c : name) {
+		h ^= c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+uint32_t Interner::intern(std::string_view name) {
+	if ((names.size() + 1) * 2 > slots.size()) {
+		grow();
+	}
+	auto h = hash(name);
+	auto mask = slots.size() - 1;
+	lookupCount++;
+	for (auto i = h & mask;; i = (i + 1) & mask) {
+		probeCount++;
+		auto slot = slots[i];
+		if (slot == 0) {
+			uint32_t id = names.size();
+			names.push_back(store(name));
+			hashes.push_back(h);
+			slots[i] = id + 1;
+			return id;
+		}
+		if (hashes[slot - 1] == h && names[slot - 1] == name) {
+			return slot - 1;
+		}
+	}
+}
+
+uint32_t Interner::find(std::string_view name) const {
+	if (slots.empty()) {
+		return NOT_FOUND;
+	}
+	auto h = hash(name);
+	auto mask = slots.size() - 1;
+	for (auto i = h & mask;; i = (i + 1) & mask) {
+		auto slot = slots[i];
+		if (slot == 0) {
+			return NOT_FOUND;
+		}
+		if (hashes[slot - 1] == h && names[slot - 1] == name) {
+			return slot - 1;
+		}
+	}
+}
+
+std::string_view Interner::name(uint32_t id) const {
+	return names[id];
+}
+
+uint32_t Interner::size() const {
+	return names.size();
+}
+
+void Interner::clear() {
+	blocks.clear();
+	blockUsed = blockCapacity = 0;
+	names.clear();
+	hashes.clear();
+	lookupCount = probeCount = 0;
+	std::fill(slots.begin(), slots.end(), 0);
+}
+
+void Interner::grow() {
+	slots.assign(std::max<size_t>(64, slots.size() * 2), 0);
+	auto mask = slots.size() - 1;
+	for (uint32_t id = 0; id < names.size(); id++) {
+		auto i = hashes[id] & mask;
+		while (slots[i] != 0) {
+			i = (i + 1) & mask;
+		}
+		slots[i] = id + 1;
+	}
+}
+
+std::string_view Interner::store(std::string_view name) {
+	if (blocks.empty() || name.size() > blockCapacity - blockUsed) {
+		blockCapacity = std::max(BLOCK_SIZE, name.size());
+		blocks.emplace_back(new char[blockCapacity]);
+		blockUsed = 0;
+	}
+	auto copy = blocks.back().get() + blockUsed;
+	if (!name.empty()) {
+		std::memcpy(copy, name.data(), name.size());
+	}
+	blockUsed += name.size();
+	return std::string_view(copy, name.size());
+}
@@ -0,0 +1,52 @@
+#ifndef _interner_hpp_
+#define _interner_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/*
+ * Maps identifiers to dense IDs 0, 1, 2... in order of first appearance.
+ * Names are copied once into an arena, the views name() returns stay valid until clear().
+ */
+class Interner {
+public:
+	static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+	uint32_t intern(std::string_view name);
+	uint32_t find(std::string_view name) const;
+
+	std::string_view name(uint32_t id) const;
+	uint32_t size() const;
+	void clear();
+
+	// intern() calls and slots visited by them since clear(), for --stats
+	uint64_t lookups() const {
+		return lookupCount;
+	}
+	uint64_t probes() const {
+		return probeCount;
+	}
+	size_t capacity() const {
+		return slots.size();
+	}
+private:
+	static uint32_t hash(std::string_view name);
+	void grow();
+	std::string_view store(std::string_view name);
+
+	static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+	std::vector<std::unique_ptr<char[]>> blocks;
+	size_t blockUsed = 0, blockCapacity = 0;
+
+	std::vector<std::string_view> names;
+	std::vector<uint32_t> hashes;
+	std::vector<uint32_t> slots;	// open addressing, id + 1, 0 - empty
+
+	uint64_t lookupCount = 0, probeCount = 0;
+};
+
+#endif
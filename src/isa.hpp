@@ -0,0 +1,134 @@
+#ifndef _isa_hpp_
+#define _isa_hpp_
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Instruction set, the only place mnemonics, operation codes and operand forms are listed.
+ * The enum value is the operation code and the index into ISA.
+ */
+enum Instruction : uint8_t {
+	OP_HALT, OP_IRET, OP_RET, OP_INT, OP_CALL, OP_JMP, OP_JEQ, OP_JNE, OP_JGT, OP_PUSH, OP_POP,
+	OP_XCHG, OP_MOV, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_CMP, OP_NOT, OP_AND, OP_OR, OP_XOR,
+	OP_TEST, OP_SHL, OP_SHR, OP_COUNT
+};
+
+typedef struct {
+	const char *name;
+	uint8_t operands;	// 0, 1 or 2
+	bool sized;	// takes a b/w suffix for byte or word operands
+	bool jump;	// operand in jump syntax, *addr for memory
+} isaEntry;
+
+constexpr isaEntry ISA[] = {
+	{ "halt", 0, false, false }, { "iret", 0, false, false }, { "ret", 0, false, false },
+	{ "int", 1, false, true }, { "call", 1, false, true }, { "jmp", 1, false, true },
+	{ "jeq", 1, false, true }, { "jne", 1, false, true }, { "jgt", 1, false, true },
+	{ "push", 1, false, false }, { "pop", 1, false, false },
+	{ "xchg", 2, true, false }, { "mov", 2, true, false }, { "add", 2, true, false },
+	{ "sub", 2, true, false }, { "mul", 2, true, false }, { "div", 2, true, false },
+	{ "cmp", 2, true, false }, { "not", 2, true, false }, { "and", 2, true, false },
+	{ "or", 2, true, false }, { "xor", 2, true, false }, { "test", 2, true, false },
+	{ "shl", 2, true, false }, { "shr", 2, true, false }
+};
+
+static_assert(sizeof(ISA) / sizeof(ISA[0]) == OP_COUNT, "ISA table out of sync with Instruction");
+
+// Addressing modes, the addressMode field of the second instruction byte
+static constexpr uint8_t IMMED = 0x0, REGDIR = 0x1, REGIND = 0x2, REGIND16B = 0x3, MEMDIR = 0x4,
+		NO_ADDRESSING = 0xff;
+
+// bytes after the addressing byte by mode, a byte sized immediate takes one
+static constexpr uint8_t OPERAND_VALUE_BYTES[] = { 2, 0, 0, 2, 2 };
+
+// operation code :5, operand size :1 (1 - word), unused :2
+constexpr uint8_t instructionByte(uint8_t opcode, uint8_t size) {
+	return (opcode << 3) | (size << 2);
+}
+
+// addressing mode :3, register :4, part :1 (1 - high byte of the register)
+constexpr uint8_t operandByte(uint8_t mode, uint8_t reg, uint8_t part) {
+	return (mode << 5) | (reg << 1) | part;
+}
+
+// names other than r0-r7, sp, pc and psw (%r0l style byte registers) encode as 0
+constexpr uint8_t registerCode(std::string_view name) {
+	if (name.size() == 2 && name[0] == 'r' && name[1] >= '0' && name[1] <= '7') {
+		return name[1] - '0';
+	}
+	return (name == "sp") ? 0x6 : (name == "pc") ? 0x7 : (name == "psw") ? 0xf : 0;
+}
+
+// One operand as written, value is the literal or symbol text
+typedef struct {
+	uint8_t mode;
+	uint8_t reg;
+	uint8_t part;
+	bool symbolic;
+	bool pcRelative;	// symbol(%pc), the displacement is relative to the next instruction
+	std::string_view value;
+} instructionOperand;
+
+// Mnemonic with the size suffix resolved
+typedef struct {
+	Instruction opcode;
+	uint8_t size;	// 1 - word, 0 - byte
+} isaInstruction;
+
+/*
+ * Perfect hash of the base mnemonics, collisions are rejected at compile time.
+ * Needs at least two characters.
+ */
+static constexpr size_t MNEMONIC_HASH_SIZE = 64;
+
+constexpr size_t mnemonicHash(std::string_view name) {
+	return ((unsigned char)name[0] + (unsigned char)name[1] * 8 + (unsigned char)name.back() * 35 + name.size())
+			& (MNEMONIC_HASH_SIZE - 1);
+}
+
+constexpr std::array<uint8_t, MNEMONIC_HASH_SIZE> buildMnemonicTable() {
+	std::array<uint8_t, MNEMONIC_HASH_SIZE> table {};
+	for (auto& slot : table) {
+		slot = OP_COUNT;
+	}
+	for (uint8_t op = 0; op < OP_COUNT; op++) {
+		auto& slot = table[mnemonicHash(ISA[op].name)];
+		if (slot != OP_COUNT) {
+			throw "mnemonic hash collision";
+		}
+		slot = op;
+	}
+	return table;
+}
+
+constexpr auto mnemonicTable = buildMnemonicTable();
+
+constexpr uint8_t findMnemonic(std::string_view name) {
+	if (name.size() < 2) {
+		return OP_COUNT;
+	}
+	auto op = mnemonicTable[mnemonicHash(name)];
+	return (op != OP_COUNT && name == ISA[op].name) ? op : (uint8_t)OP_COUNT;
+}
+
+// false if token isn't a mnemonic, two operand mnemonics default to word size
+constexpr bool decodeMnemonic(std::string_view token, isaInstruction& instruction) {
+	auto op = findMnemonic(token);
+	if (op != OP_COUNT) {
+		instruction = { (Instruction)op, 1 };
+		return true;
+	}
+	if (token.empty() || (token.back() != 'b' && token.back() != 'w')) {
+		return false;
+	}
+	op = findMnemonic(token.substr(0, token.size() - 1));
+	if (op == OP_COUNT || !ISA[op].sized) {
+		return false;
+	}
+	instruction = { (Instruction)op, (uint8_t)(token.back() == 'w') };
+	return true;
+}
+
+#endif
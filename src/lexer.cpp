@@ -0,0 +1,586 @@
+#include <array>
+#include <cstring>
+
+#include "lexer.hpp"
+
+namespace {
+
+constexpr uint8_t WS = 0x01, ID_START = 0x02, ID_CHAR = 0x04, DIGIT = 0x08, HEX = 0x10, LETTER = 0x20;
+
+constexpr std::array<uint8_t, 256> makeCharTable() {
+	std::array<uint8_t, 256> table {};
+	table[' '] = table['\t'] = WS;
+	for (int c = 'a'; c <= 'z'; c++) {
+		table[c] |= ID_START | ID_CHAR | LETTER;
+		table[c - 'a' + 'A'] |= ID_START | ID_CHAR | LETTER;
+	}
+	for (int c = 'a'; c <= 'f'; c++) {
+		table[c] |= HEX;
+		table[c - 'a' + 'A'] |= HEX;
+	}
+	for (int c = '0'; c <= '9'; c++) {
+		table[c] |= ID_CHAR | DIGIT | HEX;
+	}
+	table['_'] |= ID_START | ID_CHAR;
+	return table;
+}
+
+constexpr auto charTable = makeCharTable();
+
+inline bool is(std::string_view s, size_t i, uint8_t cls) {
+	return i < s.size() && (charTable[(uint8_t)s[i]] & cls);
+}
+
+inline size_t skip(std::string_view s, size_t i, uint8_t cls) {
+	while (is(s, i, cls)) {
+		i++;
+	}
+	return i;
+}
+
+inline bool startsWith(std::string_view s, size_t i, const char *prefix) {
+	return s.compare(i, strlen(prefix), prefix) == 0;
+}
+
+// [ \t]*(?:#.*)*$ , '.' does not match line terminators
+bool restOk(std::string_view s, size_t i) {
+	i = skip(s, i, WS);
+	if (i == s.size()) {
+		return true;
+	}
+	if (s[i] != '#') {
+		return false;
+	}
+	return s.find_first_of("\r\n", i) == std::string_view::npos;
+}
+
+// [a-zA-Z_][a-zA-Z_0-9]*, returns end or i if there is no identifier
+size_t identifier(std::string_view s, size_t i) {
+	if (!is(s, i, ID_START)) {
+		return i;
+	}
+	return skip(s, i + 1, ID_CHAR);
+}
+
+// r[0-7]|pc|sp
+bool isRegister(std::string_view s, size_t i) {
+	if (i + 2 > s.size()) {
+		return false;
+	}
+	if (s[i] == 'r') {
+		return s[i + 1] >= '0' && s[i + 1] <= '7';
+	}
+	return (s[i] == 'p' && s[i + 1] == 'c') || (s[i] == 's' && s[i + 1] == 'p');
+}
+
+// \(%(?:r[0-7]|pc|sp)\)
+bool isRegisterIndirect(std::string_view s, size_t i) {
+	return i + 5 <= s.size() && s[i] == '(' && s[i + 1] == '%' && isRegister(s, i + 2) && s[i + 4] == ')';
+}
+
+/*
+ * Whole operand checks, the alternatives of the operand group in the line regexes
+ */
+
+// (?:0x|-)?[1-9a-fA-F][0-9a-fA-F]*
+bool jumpLiteral(std::string_view s) {
+	size_t i = 0;
+	if (startsWith(s, 0, "0x") && is(s, 2, HEX) && s[2] != '0') {
+		i = 2;
+	} else if (is(s, 0, HEX) && s[0] != '0') {
+		i = 0;
+	} else if (!s.empty() && s[0] == '-' && is(s, 1, HEX) && s[1] != '0') {
+		i = 1;
+	} else {
+		return false;
+	}
+	return skip(s, i, HEX) == s.size();
+}
+
+// (?:0x|-)?[0-9a-fA-F]+
+bool instrLiteral(std::string_view s) {
+	if (startsWith(s, 0, "0x") && is(s, 2, HEX) && skip(s, 2, HEX) == s.size()) {
+		return true;
+	}
+	size_t i = (!s.empty() && s[0] == '-') ? 1 : 0;
+	return is(s, i, HEX) && skip(s, i, HEX) == s.size();
+}
+
+bool isIdentifier(std::string_view s) {
+	return !s.empty() && identifier(s, 0) == s.size();
+}
+
+// strips an optional trailing (%reg)
+std::string_view withoutDisplacementRegister(std::string_view s) {
+	if (s.size() >= 5 && isRegisterIndirect(s, s.size() - 5)) {
+		return s.substr(0, s.size() - 5);
+	}
+	return s;
+}
+
+bool validJumpOperand(std::string_view s) {
+	if (!s.empty() && s[0] == '*') {
+		s.remove_prefix(1);
+	}
+	if (s.size() == 3 && s[0] == '%' && isRegister(s, 1)) {
+		return true;
+	}
+	if (s.size() == 5 && isRegisterIndirect(s, 0)) {
+		return true;
+	}
+	auto base = withoutDisplacementRegister(s);
+	return jumpLiteral(base) || isIdentifier(base);
+}
+
+bool validInstrOperand(std::string_view s) {
+	if (!s.empty() && s[0] == '%') {
+		return (s.size() == 3 || (s.size() == 4 && (s[3] == 'l' || s[3] == 'h'))) && isRegister(s, 1);
+	}
+	if (s.size() == 5 && isRegisterIndirect(s, 0)) {
+		return true;
+	}
+	if (!s.empty() && s[0] == '$') {
+		s.remove_prefix(1);
+	}
+	auto base = withoutDisplacementRegister(s);
+	return instrLiteral(base) || isIdentifier(base);
+}
+
+/*
+ * Line forms
+ */
+
+// ^(?:\.section[ \t]+)?\.([a-zA-Z]+)
+bool sectionLine(std::string_view line, lineMatch& match) {
+	if (startsWith(line, 0, ".section") && is(line, 8, WS)) {
+		auto i = skip(line, 8, WS);
+		if (i < line.size() && line[i] == '.') {
+			auto end = skip(line, i + 1, LETTER);
+			if (end > i + 1 && restOk(line, end)) {
+				match.type = regexSection;
+				match.group[SECTION] = line.substr(i + 1, end - i - 1);
+				return true;
+			}
+		}
+	}
+	auto end = skip(line, 1, LETTER);
+	if (end > 1 && restOk(line, end)) {
+		match.type = regexSection;
+		match.group[SECTION] = line.substr(1, end - 1);
+		return true;
+	}
+	return false;
+}
+
+// [a-zA-Z_0-9+\-*/&|<>() \t]+ up to a comment, returns end or npos
+// the expression itself is parsed by Expression::compile
+size_t expressionEnd(std::string_view s, size_t i) {
+	auto end = i, last = i;
+	while (end < s.size() && (is(s, end, ID_CHAR | WS) || (s[end] != '\0' && strchr("+-*/&|<>()", s[end])))) {
+		if (!is(s, end, WS)) {
+			last = end + 1;
+		}
+		end++;
+	}
+	return (last == i) ? std::string_view::npos : last;
+}
+
+// ^\.equ[ \t]+symbol,[ \t]*expression
+bool equLine(std::string_view line, lineMatch& match) {
+	if (!startsWith(line, 0, ".equ") || !is(line, 4, WS)) {
+		return false;
+	}
+	auto start = skip(line, 4, WS);
+	auto end = identifier(line, start);
+	if (end == start || end >= line.size() || line[end] != ',') {
+		return false;
+	}
+	auto exprStart = skip(line, end + 1, WS);
+	auto i = expressionEnd(line, exprStart);
+	if (i == std::string_view::npos || !restOk(line, i)) {
+		return false;
+	}
+	match.type = regexEqu;
+	match.group[SYMBOL] = line.substr(start, end - start);
+	match.group[EXPRESSION] = line.substr(exprStart, i - exprStart);
+	return true;
+}
+
+// symbol(?:,symbol)*, returns end or npos
+size_t identifierListEnd(std::string_view s, size_t i) {
+	while (true) {
+		auto end = identifier(s, i);
+		if (end == i) {
+			return std::string_view::npos;
+		}
+		i = end;
+		if (i < s.size() && s[i] == ',') {
+			i++;
+		} else {
+			return i;
+		}
+	}
+}
+
+// ^\.global|\.extern[ \t]+symbol(?:,symbol)*
+bool symbolListLine(std::string_view line, const char *directive, RegexTypes type, lineMatch& match) {
+	auto length = strlen(directive);
+	if (!startsWith(line, 0, directive) || !is(line, length, WS)) {
+		return false;
+	}
+	auto start = skip(line, length, WS);
+	auto i = identifierListEnd(line, start);
+	if (i == std::string_view::npos || !restOk(line, i)) {
+		return false;
+	}
+	match.type = type;
+	match.group[SYMBOL] = line.substr(start, i - start);
+	return true;
+}
+
+// ^\.macro[ \t]+name(?:[ \t]+parameter(?:,parameter)*)?
+bool macroLine(std::string_view line, lineMatch& match) {
+	if (!startsWith(line, 0, ".macro") || !is(line, 6, WS)) {
+		return false;
+	}
+	auto start = skip(line, 6, WS);
+	auto end = identifier(line, start);
+	if (end == start) {
+		return false;
+	}
+	match.group[SYMBOL] = line.substr(start, end - start);
+	auto i = end;
+	if (is(line, i, WS)) {
+		auto listStart = skip(line, i, WS);
+		auto listEnd = identifierListEnd(line, listStart);
+		if (listEnd != std::string_view::npos) {
+			match.group[LIST] = line.substr(listStart, listEnd - listStart);
+			i = listEnd;
+		}
+	}
+	if (!restOk(line, i)) {
+		return false;
+	}
+	match.type = regexMacro;
+	return true;
+}
+
+// ^\.include[ \t]+"path"
+bool includeLine(std::string_view line, lineMatch& match) {
+	if (!startsWith(line, 0, ".include") || !is(line, 8, WS)) {
+		return false;
+	}
+	auto start = skip(line, 8, WS);
+	if (start == line.size() || line[start] != '"') {
+		return false;
+	}
+	auto end = line.find('"', start + 1);
+	if (end == std::string_view::npos || end == start + 1 || !restOk(line, end + 1)) {
+		return false;
+	}
+	match.type = regexInclude;
+	match.group[SYMBOL] = line.substr(start + 1, end - start - 1);
+	return true;
+}
+
+// [ \t]*\.endm|\.endr
+bool blockEndLine(std::string_view line, size_t i, lineMatch& match) {
+	if (startsWith(line, i, ".endm") && restOk(line, i + 5)) {
+		match.type = regexEndm;
+		return true;
+	}
+	if (startsWith(line, i, ".endr") && restOk(line, i + 5)) {
+		match.type = regexEndr;
+		return true;
+	}
+	return false;
+}
+
+// list of a data directive, returns end or npos
+size_t dataListEnd(std::string_view s, size_t i, RegexTypes type) {
+	if (type == regexByte || type == regexWord) {
+		// -?[a-zA-Z_0-9]+(?:,-?[a-zA-Z_0-9]+)*
+		while (true) {
+			if (i < s.size() && s[i] == '-') {
+				i++;
+			}
+			auto end = skip(s, i, ID_CHAR);
+			if (end == i) {
+				return std::string_view::npos;
+			}
+			i = end;
+			if (i < s.size() && s[i] == ',') {
+				i++;
+			} else {
+				return i;
+			}
+		}
+	}
+	// (?:0x)?[0-9a-fA-F]+, .fill and .align take a list of them, the last .fill value may be negative
+	while (true) {
+		if (type == regexFill && i < s.size() && s[i] == '-') {
+			i++;
+		}
+		if (startsWith(s, i, "0x") && is(s, i + 2, HEX)) {
+			i += 2;
+		}
+		auto end = skip(s, i, HEX);
+		if (end == i) {
+			return std::string_view::npos;
+		}
+		i = end;
+		if ((type == regexFill || type == regexAlign) && i < s.size() && s[i] == ',') {
+			i++;
+		} else {
+			return i;
+		}
+	}
+}
+
+// \.byte|\.word|\.skip|\.zero|\.fill|\.align|\.rept[ \t]+argument
+bool dataLine(std::string_view line, size_t i, lineMatch& match) {
+	static constexpr struct {
+		const char *name;
+		RegexTypes type;
+	} directives[] = { { ".byte", regexByte }, { ".word", regexWord }, { ".skip", regexSkip }, { ".zero", regexZero },
+			{ ".fill", regexFill }, { ".align", regexAlign }, { ".rept", regexRept } };
+	RegexTypes type = regexComment;
+	size_t length = 0;
+	for (auto& directive : directives) {
+		if (startsWith(line, i, directive.name)) {
+			type = directive.type;
+			length = strlen(directive.name);
+			break;
+		}
+	}
+	if (length == 0 || !is(line, i + length, WS)) {
+		return false;
+	}
+	auto start = skip(line, i + length, WS);
+	i = dataListEnd(line, start, type);
+	if (i == std::string_view::npos || !restOk(line, i)) {
+		return false;
+	}
+	match.type = type;
+	match.group[LIST] = line.substr(start, i - start);
+	return true;
+}
+
+bool instructionLine(std::string_view line, size_t i, lineMatch& match) {
+	auto end = identifier(line, i);
+	if (end == i || !decodeMnemonic(line.substr(i, end - i), match.instruction)) {
+		return false;
+	}
+	static constexpr RegexTypes types[] = { regexInstrNoOperand, regexInstrOneOperand, regexInstrTwoOperand };
+	auto type = types[ISA[match.instruction.opcode].operands];
+	match.group[OPERATION] = line.substr(i, end - i);
+
+	if (type == regexInstrNoOperand) {
+		if (!restOk(line, end)) {
+			return false;
+		}
+		match.type = type;
+		return true;
+	}
+
+	if (!is(line, end, WS)) {
+		return false;
+	}
+	auto start = skip(line, end, WS);
+
+	if (type == regexInstrOneOperand) {
+		auto stop = line.find_first_of(" \t#", start);
+		if (stop == std::string_view::npos) {
+			stop = line.size();
+		}
+		auto operand = line.substr(start, stop - start);
+		if (!validJumpOperand(operand) || !restOk(line, stop)) {
+			return false;
+		}
+		match.type = type;
+		match.group[ARG1] = operand;
+		return true;
+	}
+
+	auto comma = line.find(',', start);
+	if (comma == std::string_view::npos) {
+		return false;
+	}
+	auto operand1 = line.substr(start, comma - start);
+	auto start2 = skip(line, comma + 1, WS);
+	auto stop = line.find_first_of(" \t#", start2);
+	if (stop == std::string_view::npos) {
+		stop = line.size();
+	}
+	auto operand2 = line.substr(start2, stop - start2);
+	if (!validInstrOperand(operand1) || !validInstrOperand(operand2) || !restOk(line, stop)) {
+		return false;
+	}
+	match.type = type;
+	match.group[ARG1] = operand1;
+	match.group[ARG2] = operand2;
+	return true;
+}
+
+/*
+ * Leftmost match of the operand regexes inside an already validated operand,
+ * returns length of the match of alternative alt at position i, 0 if it doesn't match
+ */
+
+// (?:0x[0-9a-fA-F]+|-?[1-9][0-9]*) or with decimal = false (?:0x[0-9a-fA-F]+|-?[0-9]+)
+size_t numberAt(std::string_view s, size_t i, bool nonZeroStart) {
+	if (startsWith(s, i, "0x") && is(s, i + 2, HEX)) {
+		return skip(s, i + 2, HEX);
+	}
+	if (i < s.size() && s[i] == '-') {
+		i++;
+	}
+	if (!is(s, i, DIGIT) || (nonZeroStart && s[i] == '0')) {
+		return 0;
+	}
+	return skip(s, i, DIGIT);
+}
+
+size_t displacementAt(std::string_view s, size_t i) {
+	return isRegisterIndirect(s, i) ? i + 5 : i;
+}
+
+size_t jumpAlternative(std::string_view s, size_t start, int alt) {
+	size_t i = start;
+	switch (alt) {
+	case 1:
+		if (i < s.size() && s[i] == '*') {
+			i++;
+		}
+		i = numberAt(s, i, true);
+		return i ? displacementAt(s, i) - start : 0;
+	case 2: {
+		if (i < s.size() && s[i] == '*') {
+			i++;
+		}
+		auto end = identifier(s, i);
+		return end != i ? displacementAt(s, end) - start : 0;
+	}
+	case 3:
+		return (startsWith(s, i, "*%") && isRegister(s, i + 2)) ? 4 : 0;
+	case 4:
+		return (i < s.size() && s[i] == '*' && isRegisterIndirect(s, i + 1)) ? 6 : 0;
+	}
+	return 0;
+}
+
+size_t instrAlternative(std::string_view s, size_t start, int alt) {
+	size_t i = start;
+	switch (alt) {
+	case 1:
+		if (i < s.size() && s[i] == '$') {
+			i++;
+		}
+		i = numberAt(s, i, false);
+		return i ? displacementAt(s, i) - start : 0;
+	case 2: {
+		if (i < s.size() && s[i] == '$') {
+			i++;
+		}
+		auto end = identifier(s, i);
+		return end != i ? displacementAt(s, end) - start : 0;
+	}
+	case 3:
+		if (i < s.size() && s[i] == '%' && isRegister(s, i + 1)) {
+			return (i + 3 < s.size() && (s[i + 3] == 'l' || s[i + 3] == 'h')) ? 4 : 3;
+		}
+		return 0;
+	case 4:
+		return isRegisterIndirect(s, i) ? 5 : 0;
+	}
+	return 0;
+}
+
+template<typename F>
+operandMatch search(std::string_view s, F alternative) {
+	for (size_t i = 0; i < s.size(); i++) {
+		for (uint8_t alt = 1; alt < 5; alt++) {
+			auto length = alternative(s, i, alt);
+			if (length) {
+				return { alt, s.substr(i, length) };
+			}
+		}
+	}
+	return { 0, std::string_view() };
+}
+
+}
+
+bool Lexer::classify(std::string_view line, lineMatch& match) {
+	match = lineMatch();
+	auto i = skip(line, 0, WS);
+
+	if (i == line.size() || line[i] == '#') {
+		match.type = regexComment;
+		return restOk(line, i);
+	}
+
+	// before section lines, .endm and .endr aren't section names
+	if (line[i] == '.' && blockEndLine(line, i, match)) {
+		return true;
+	}
+
+	if (i == 0 && line[0] == '.') {
+		if (sectionLine(line, match) || equLine(line, match) || macroLine(line, match) || includeLine(line, match)
+				|| symbolListLine(line, ".global", regexGlobal, match)
+				|| symbolListLine(line, ".extern", regexExtern, match)) {
+			return true;
+		}
+	}
+
+	// optional label
+	auto end = identifier(line, i);
+	if (end != i && end < line.size() && line[end] == ':') {
+		match.group[LABEL] = line.substr(i, end - i);
+		if (restOk(line, end + 1)) {
+			match.type = regexLabel;
+			return true;
+		}
+		i = skip(line, end + 1, WS);
+	}
+
+	if (i < line.size() && line[i] == '.') {
+		return dataLine(line, i, match);
+	}
+	return instructionLine(line, i, match);
+}
+
+bool Lexer::validGroup(RegexTypes type, uint8_t group, std::string_view text) {
+	if (text.empty() || text.find_first_of(" \t#") != std::string_view::npos) {
+		return false;
+	}
+	switch (type) {
+	case regexEqu:
+		return (group == SYMBOL) ? isIdentifier(text) : expressionEnd(text, 0) == text.size();
+	case regexGlobal:
+	case regexExtern:
+		return identifierListEnd(text, 0) == text.size();
+	case regexInstrOneOperand:
+		return (group == ARG1) ? validJumpOperand(text) : group == LABEL && isIdentifier(text);
+	case regexInstrTwoOperand:
+		return (group == ARG1 || group == ARG2) ? validInstrOperand(text) : group == LABEL && isIdentifier(text);
+	case regexByte:
+	case regexWord:
+	case regexSkip:
+	case regexZero:
+	case regexFill:
+	case regexAlign:
+	case regexRept:
+		return (group == LIST) ? dataListEnd(text, 0, type) == text.size() : isIdentifier(text);
+	default:
+		return group == LABEL && isIdentifier(text);
+	}
+}
+
+operandMatch Lexer::classifyJumpOperand(std::string_view operand) {
+	return search(operand, jumpAlternative);
+}
+
+operandMatch Lexer::classifyInstrOperand(std::string_view operand) {
+	return search(operand, instrAlternative);
+}
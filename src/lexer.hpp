@@ -0,0 +1,44 @@
+#ifndef _lexer_hpp_
+#define _lexer_hpp_
+
+#include <cstdint>
+#include <string_view>
+
+#include "auxiliary.hpp"
+#include "isa.hpp"
+
+/*
+ * Result of classifying one source line.
+ * group[i] holds the same text capture group i of the old per-line regexes held,
+ * an absent optional group (no label) is an empty view.
+ */
+typedef struct {
+	RegexTypes type;
+	std::string_view group[5];
+	isaInstruction instruction;	// decoded OPERATION of instruction lines
+} lineMatch;
+
+/*
+ * Operand class as reported by the old operand regexes
+ * (1) literal form, (2) symbol form, (3) register direct, (4) register indirect, 0 - no match
+ */
+typedef struct {
+	uint8_t kind;
+	std::string_view text;
+} operandMatch;
+
+// line type of a line kept for classifying later, it matched none of the line forms
+static constexpr RegexTypes UNCLASSIFIED = (RegexTypes)numberOfRegex;
+
+class Lexer {
+public:
+	// false if the line matches none of the supported line forms
+	static bool classify(std::string_view line, lineMatch& match);
+	// group of a line of this type would match text, for groups built from macro arguments
+	static bool validGroup(RegexTypes type, uint8_t group, std::string_view text);
+
+	static operandMatch classifyJumpOperand(std::string_view operand);
+	static operandMatch classifyInstrOperand(std::string_view operand);
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <iostream>
+
+#include "logger.hpp"
+
+bool parseLogLevel(std::string_view name, LogLevel& level) {
+	static constexpr std::string_view names[] = { "off", "error", "info", "trace" };
+	for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (name == names[i]) {
+			level = (LogLevel)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+Logger::~Logger() {
+	close();
+}
+
+void Logger::setLevel(LogLevel level) {
+	this->level = level;
+}
+
+LogLevel Logger::getLevel() const {
+	return level;
+}
+
+bool Logger::openFile(const std::string& path) {
+	close();
+	file.open(path, std::ios::out | std::ios::trunc);
+	if (!file.good()) {
+		return false;
+	}
+	sink = SINK_FILE;
+	return true;
+}
+
+void Logger::useStderr() {
+	close();
+	sink = SINK_STDERR;
+}
+
+void Logger::useRing(size_t lines) {
+	close();
+	if (lines == 0) {
+		return;
+	}
+	ring.assign(lines, std::string());
+	sink = SINK_RING;
+}
+
+void Logger::close() {
+	flush();
+	if (file.is_open()) {
+		file.close();
+	}
+	ring.clear();
+	ringNext = 0;
+	ringFull = false;
+	sink = SINK_NONE;
+}
+
+void Logger::flush() {
+	if (pending.empty()) {
+		return;
+	}
+	if (sink == SINK_FILE) {
+		file.write(pending.data(), pending.size());
+		file.flush();
+	} else if (sink == SINK_STDERR) {
+		std::cerr.write(pending.data(), pending.size());
+	}
+	pending.clear();
+}
+
+void Logger::write() {
+	if (sink == SINK_RING) {
+		ring[ringNext].assign(line);
+		if (++ringNext == ring.size()) {
+			ringNext = 0;
+			ringFull = true;
+		}
+		return;
+	}
+	pending.append(line).push_back('\n');
+	if (pending.size() >= FLUSH_SIZE) {
+		flush();
+	}
+}
+
+std::vector<std::string> Logger::recent() const {
+	std::vector<std::string> lines;
+	if (ringFull) {
+		lines.insert(lines.end(), ring.begin() + ringNext, ring.end());
+	}
+	lines.insert(lines.end(), ring.begin(), ring.begin() + ringNext);
+	return lines;
+}
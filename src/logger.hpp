@@ -0,0 +1,107 @@
+#ifndef _logger_hpp_
+#define _logger_hpp_
+
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+enum LogLevel : uint8_t {
+	LOG_OFF, LOG_ERROR, LOG_INFO, LOG_TRACE
+};
+
+// off, error, info, trace
+bool parseLogLevel(std::string_view name, LogLevel& level);
+
+/*
+ * Leveled log with one sink: a file, stderr or a ring of the most recent lines.
+ * Off by default. Messages are passed as pieces and only formatted when the level is enabled,
+ * file and stderr output is written in large blocks, not per line.
+ */
+class Logger {
+public:
+	Logger() = default;
+	~Logger();
+
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	void setLevel(LogLevel level);
+	LogLevel getLevel() const;
+
+	bool openFile(const std::string& path);
+	void useStderr();
+	void useRing(size_t lines);
+	// flushes and drops the sink
+	void close();
+	void flush();
+
+	// ring contents, oldest first
+	std::vector<std::string> recent() const;
+
+	bool enabled(LogLevel level) const {
+		return level <= this->level && sink != SINK_NONE;
+	}
+
+	template<typename... Args>
+	void log(LogLevel level, const Args&... args) {
+		if (!enabled(level)) {
+			return;
+		}
+		line.clear();
+		(append(args), ...);
+		write();
+	}
+
+	template<typename... Args>
+	void error(const Args&... args) {
+		log(LOG_ERROR, args...);
+	}
+
+	template<typename... Args>
+	void info(const Args&... args) {
+		log(LOG_INFO, args...);
+	}
+
+	template<typename... Args>
+	void trace(const Args&... args) {
+		log(LOG_TRACE, args...);
+	}
+private:
+	void append(std::string_view text) {
+		line.append(text);
+	}
+
+	void append(char c) {
+		line.push_back(c);
+	}
+
+	template<typename T>
+	std::enable_if_t<std::is_integral_v<T>> append(T value) {
+		char digits[24];
+		auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+		line.append(digits, end - digits);
+	}
+
+	void write();
+
+	static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+	enum {
+		SINK_NONE, SINK_FILE, SINK_STDERR, SINK_RING
+	} sink = SINK_NONE;
+	LogLevel level = LOG_OFF;
+
+	std::string line;
+	std::string pending;
+	std::ofstream file;
+
+	std::vector<std::string> ring;
+	size_t ringNext = 0;
+	bool ringFull = false;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include <algorithm>
+
+#include "macro.hpp"
+
+namespace {
+
+inline bool isIdentifierStart(char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+inline bool isIdentifierChar(char ch) {
+	return isIdentifierStart(ch) || (ch >= '0' && ch <= '9');
+}
+
+size_t identifierEnd(std::string_view s, size_t i) {
+	if (i >= s.size() || !isIdentifierStart(s[i])) {
+		return i;
+	}
+	while (i < s.size() && isIdentifierChar(s[i])) {
+		i++;
+	}
+	return i;
+}
+
+// valid in every operand and list form, so a line classifies the same with the argument left out
+constexpr char PLACEHOLDER = '1';
+
+}
+
+bool MacroCompiler::compile(const std::vector<std::string_view>& body, const std::vector<std::string_view>& parameters,
+		macroDefinition& definition, size_t& badLine) {
+	definition.parameters = parameters.size();
+	definition.lines.clear();
+
+	// labels defined in the body get the suffix of the expansion, so do the references to them
+	std::vector<std::string_view> labels;
+	for (auto line : body) {
+		auto start = line.find_first_not_of(" \t");
+		auto end = identifierEnd(line, start == std::string_view::npos ? line.size() : start);
+		if (end != start && end < line.size() && line[end] == ':') {
+			labels.push_back(line.substr(start, end - start));
+		}
+	}
+	auto isLabel = [&labels](std::string_view name) {
+		for (auto label : labels) {
+			if (label == name) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	std::vector<int> argumentAt;
+	for (size_t index = 0; index < body.size(); index++) {
+		auto raw = body[index];
+		macroLine line;
+		argumentAt.clear();
+		for (size_t i = 0; i < raw.size(); i++) {
+			if (raw[i] == '\\') {
+				auto end = identifierEnd(raw, i + 1);
+				auto name = raw.substr(i + 1, end - i - 1);
+				size_t parameter = 0;
+				while (parameter < parameters.size() && parameters[parameter] != name) {
+					parameter++;
+				}
+				if (end != i + 1 && parameter < parameters.size()) {
+					argumentAt.resize(line.text.size(), -1);
+					argumentAt.push_back(parameter);
+					line.text += PLACEHOLDER;
+					i = end - 1;
+					continue;
+				}
+			}
+			line.text += raw[i];
+		}
+		argumentAt.resize(line.text.size(), -1);
+
+		lineMatch match;
+		size_t groupBegin[5] = { }, groupEnd[5] = { };
+		if (Lexer::classify(line.text, match)) {
+			switch (match.type) {
+			case regexComment:
+				continue;
+			case regexSection:
+			case regexMacro:
+			case regexEndm:
+			case regexRept:
+			case regexEndr:
+				badLine = index;
+				return false;
+			default:
+				break;
+			}
+			line.type = match.type;
+			line.instruction = match.instruction;
+			for (uint8_t g = 1; g < 5; g++) {
+				if (!match.group[g].empty()) {
+					groupBegin[g] = match.group[g].data() - line.text.data();
+					groupEnd[g] = groupBegin[g] + match.group[g].size();
+				}
+			}
+		} else {
+			line.type = UNCLASSIFIED;
+			groupEnd[0] = line.text.size();
+		}
+
+		auto instruction = line.type == regexInstrNoOperand || line.type == regexInstrOneOperand
+				|| line.type == regexInstrTwoOperand;
+		for (uint8_t g = 0; g < 5; g++) {
+			line.first[g] = line.parts.size();
+			auto textStart = groupBegin[g];
+			auto flush = [&](size_t end) {
+				if (end > textStart) {
+					line.parts.push_back( { PART_TEXT, (uint32_t)textStart, (uint32_t)(end - textStart) });
+				}
+			};
+			auto pos = groupBegin[g];
+			while (pos < groupEnd[g]) {
+				if (argumentAt[pos] >= 0) {
+					flush(pos);
+					line.parts.push_back( { PART_ARGUMENT, (uint32_t)argumentAt[pos], 0 });
+					textStart = ++pos;
+					continue;
+				}
+				if (!isIdentifierChar(line.text[pos])) {
+					pos++;
+					continue;
+				}
+				auto end = pos;
+				auto withArgument = false;
+				while (end < groupEnd[g] && isIdentifierChar(line.text[end])) {
+					withArgument |= argumentAt[end] >= 0;
+					end++;
+				}
+				if (withArgument) {
+					pos++;
+					continue;
+				}
+				// whole identifiers only, registers (%r1) and mnemonics are left alone
+				auto name = std::string_view(line.text).substr(pos, end - pos);
+				if (isIdentifierStart(line.text[pos]) && (pos == 0 || !isIdentifierChar(line.text[pos - 1]))
+						&& (pos == 0 || line.text[pos - 1] != '%') && !(instruction && g == OPERATION) && isLabel(name)) {
+					flush(pos);
+					line.parts.push_back( { PART_LABEL, (uint32_t)pos, (uint32_t)name.size() });
+					textStart = end;
+				}
+				pos = end;
+			}
+			flush(groupEnd[g]);
+		}
+		line.first[5] = line.parts.size();
+		definition.lines.push_back(std::move(line));
+	}
+	return true;
+}
+
+bool MacroCompiler::expand(const macroLine& line, const std::vector<std::string_view>& arguments, std::string_view suffix,
+		std::string& buffer, lineMatch& match) {
+	match = lineMatch();
+	match.type = line.type;
+	match.instruction = line.instruction;
+	buffer.clear();
+	size_t begin[5] = { }, end[5] = { };
+	for (uint8_t g = 0; g < 5; g++) {
+		auto first = line.first[g], last = line.first[g + 1];
+		if (first == last) {
+			continue;
+		}
+		if (last - first == 1 && line.parts[first].kind == PART_TEXT) {
+			match.group[g] = std::string_view(line.text).substr(line.parts[first].offset, line.parts[first].length);
+			continue;
+		}
+		begin[g] = buffer.size();
+		for (auto part = first; part < last; part++) {
+			auto& piece = line.parts[part];
+			if (piece.kind == PART_ARGUMENT) {
+				buffer.append(arguments[piece.offset]);
+			} else {
+				buffer.append(line.text, piece.offset, piece.length);
+				if (piece.kind == PART_LABEL) {
+					buffer.append(suffix);
+				}
+			}
+		}
+		end[g] = buffer.size();
+	}
+	// views only once the buffer stopped growing
+	for (uint8_t g = 0; g < 5; g++) {
+		if (end[g] != begin[g]) {
+			match.group[g] = std::string_view(buffer).substr(begin[g], end[g] - begin[g]);
+			if (line.type != UNCLASSIFIED && !Lexer::validGroup(line.type, g, match.group[g])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool MacroCompiler::splitInvocation(std::string_view line, std::string_view& label, std::string_view& name,
+		std::vector<std::string_view>& arguments) {
+	auto skipBlank = [&line](size_t i) {
+		while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+			i++;
+		}
+		return i;
+	};
+	label = std::string_view();
+	arguments.clear();
+	auto start = skipBlank(0);
+	auto end = identifierEnd(line, start);
+	if (end != start && end < line.size() && line[end] == ':') {
+		label = line.substr(start, end - start);
+		start = skipBlank(end + 1);
+		end = identifierEnd(line, start);
+	}
+	if (end == start || (end < line.size() && line[end] != ' ' && line[end] != '\t' && line[end] != '#')) {
+		return false;
+	}
+	name = line.substr(start, end - start);
+
+	auto rest = line.substr(end, line.find('#', end) - end);
+	rest.remove_prefix(std::min(rest.size(), rest.find_first_not_of(" \t")));
+	while (!rest.empty()) {
+		auto comma = rest.find(',');
+		auto argument = rest.substr(0, comma);
+		argument.remove_suffix(argument.size() - (argument.find_last_not_of(" \t") + 1));
+		if (argument.empty()) {
+			return false;
+		}
+		arguments.push_back(argument);
+		if (comma == std::string_view::npos) {
+			break;
+		}
+		rest.remove_prefix(comma + 1);
+		rest.remove_prefix(std::min(rest.size(), rest.find_first_not_of(" \t")));
+		if (rest.empty()) {
+			return false;
+		}
+	}
+	return true;
+}
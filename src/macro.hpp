@@ -0,0 +1,56 @@
+#ifndef _macro_hpp_
+#define _macro_hpp_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+
+// piece of a macro body line: text of the line, an argument or a body label made unique per expansion
+static constexpr uint8_t PART_TEXT = 0, PART_ARGUMENT = 1, PART_LABEL = 2;
+
+typedef struct {
+	uint8_t kind;
+	uint32_t offset;	// PART_TEXT, PART_LABEL: in the line text, PART_ARGUMENT: argument index
+	uint32_t length;
+} macroPart;
+
+/*
+ * Body line classified once, \parameter replaced by a placeholder.
+ * Group g is parts[first[g]] up to parts[first[g + 1]], an UNCLASSIFIED line is all group 0
+ * and goes through the lexer after substitution.
+ */
+typedef struct {
+	std::string text;
+	RegexTypes type;
+	isaInstruction instruction;
+	uint8_t first[6];
+	std::vector<macroPart> parts;
+} macroLine;
+
+typedef struct {
+	uint32_t parameters;
+	std::vector<macroLine> lines;
+} macroDefinition;
+
+class MacroCompiler {
+public:
+	// false and the index of the offending line if the body holds a line form macros can't
+	static bool compile(const std::vector<std::string_view>& body, const std::vector<std::string_view>& parameters,
+			macroDefinition& definition, size_t& badLine);
+
+	/*
+	 * Substitutes the arguments and the label suffix into match, groups without them are views
+	 * into the line, the others into buffer. False if a substituted group isn't valid for the line type.
+	 */
+	static bool expand(const macroLine& line, const std::vector<std::string_view>& arguments, std::string_view suffix,
+			std::string& buffer, lineMatch& match);
+
+	// [label:] name [argument(,argument)*], false if the line doesn't have this form
+	static bool splitInvocation(std::string_view line, std::string_view& label, std::string_view& name,
+			std::vector<std::string_view>& arguments);
+};
+
+#endif
@@ -1,30 +1,115 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <utility>
 
 #include "assembler.hpp"
+#include "batch.hpp"
+#include "server.hpp"
+
+void printUsage() {
+	std::cerr << "usage: asm src.s -o obj.o [-f text|bin] [-l off|error|info|trace] [-L log|-] [--stats[-hw] json|-] [--max-errors n] [--cache dir] [--spill dir] [-I dir]... [-Os]" << std::endl;
+	std::cerr << "       asm -b [-j workers] [-f text|bin] [-l off|error|info|trace] [-I dir]... src.s|@list ..." << std::endl;
+	std::cerr << "       asm --server socket [-j workers]" << std::endl;
+}
+
+// the check --max-errors uses, digits only and small enough for stoul
+bool validCount(const std::string& text) {
+	return !text.empty() && text.find_first_not_of("0123456789") == std::string::npos && text.size() <= 9;
+}
+
+int batchMode(int argc, char *argv[]) {
+	auto workers = 0u;
+	std::string format = "text";
+	std::string logLevel = "off";
+	std::vector<std::string> includePaths;
+	auto i = 2;
+	for (; i + 1 < argc; i += 2) {
+		std::string option(argv[i]);
+		if (option == "-j") {
+			if (!validCount(argv[i + 1])) {
+				printUsage();
+				return ERR_ARGUMENT;
+			}
+			workers = std::stoul(argv[i + 1]);
+		} else if (option == "-f") {
+			format = argv[i + 1];
+		} else if (option == "-l") {
+			logLevel = argv[i + 1];
+		} else if (option == "-I") {
+			includePaths.push_back(argv[i + 1]);
+		} else {
+			break;
+		}
+	}
+	if (i == argc) {
+		std::cerr << "*** NO SOURCE FILES ***" << std::endl;
+		printUsage();
+		return ERR_ARGUMENT;
+	}
+
+	Batch batch(workers, format, logLevel);
+	for (auto& path : includePaths) {
+		batch.addIncludePath(path);
+	}
+	for (; i < argc; i++) {
+		if (!batch.addArgument(argv[i])) {
+			return ERR_ARGUMENT;
+		}
+	}
+	return batch.run();
+}
+
+int serverMode(int argc, char *argv[]) {
+	auto workers = 0u;
+	if (argc == 5 && std::string(argv[3]) == "-j" && validCount(argv[4])) {
+		workers = std::stoul(argv[4]);
+	} else if (argc != 3) {
+		printUsage();
+		return ERR_ARGUMENT;
+	}
+	Server server(argv[2], workers);
+	return server.run();
+}
 
 int main(int argc, char *argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "-b") {
+		return batchMode(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--server") {
+		return serverMode(argc, argv);
+	}
+
 	// Lonely object of Assembler class
 	std::unique_ptr<Assembler> assembler(new Assembler());
-	/**
-	 * Check if the argument number is satisfying
-	 **/
-	if (argc != 4) {
-		std::cerr << "*** INVALID ARGUMENT NUMBER ***" << std::endl;
-		std::cerr << "usage: asm src.s -o obj.o" << std::endl;
+	try {
+		/**
+		 * Check if the argument number is satisfying
+		 **/
+		// every option takes a value but -Os
+		auto flags = std::count(argv + 1, argv + argc, std::string("-Os"));
+		if (argc - flags < 4 || (argc - flags) % 2 != 0) {
+			std::cerr << "*** INVALID ARGUMENT NUMBER ***" << std::endl;
+			printUsage();
 
-		exit(1);
-	}
+			exit(1);
+		}
 
-	std::vector<std::string> args;
-	args.push_back(std::string(argv[1]));
-	args.push_back(std::string(argv[2]));
-	args.push_back(std::string(argv[3]));
+		std::vector<std::string> args;
+		for (auto i = 1; i < argc; i++) {
+			args.push_back(std::string(argv[i]));
+		}
 
-	assembler->argumentsAnalyzer(3, args);
+		assembler->argumentsAnalyzer(argc - 1, args);
 
-	assembler->generateObj();
+		assembler->generateObj();
+	} catch (AssemblyError& error) {
+		if (!assembler->printDiagnostics(std::cerr)) {
+			std::cerr << "error: " << error.message << std::endl;
+		}
+		printf("**** Application returned error code %d ****", error.code);
+		return error.code;
+	}
 
 	return 0;
 }
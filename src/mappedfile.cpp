@@ -0,0 +1,95 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "mappedfile.hpp"
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+	auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		::close(fd);
+		return false;
+	}
+
+	if (S_ISREG(info.st_mode) && info.st_size > 0) {
+		auto address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED) {
+			madvise(address, info.st_size, MADV_SEQUENTIAL);
+			mapped = address;
+			mappedSize = info.st_size;
+			opened = true;
+			::close(fd);
+			return true;
+		}
+	}
+
+	// pipes, character devices, empty files or a failed mapping
+	opened = readBlocks(fd);
+	::close(fd);
+	return opened;
+}
+
+bool MappedFile::readBlocks(int fd) {
+	size_t used = 0;
+	while (true) {
+		if (buffer.size() - used < BLOCK_SIZE) {
+			buffer.resize(std::max(buffer.size() * 2, BLOCK_SIZE));
+		}
+		auto count = read(fd, &buffer[used], buffer.size() - used);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			buffer.clear();
+			return false;
+		}
+		if (count == 0) {
+			break;
+		}
+		used += count;
+	}
+	buffer.resize(used);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped != nullptr) {
+		munmap(mapped, mappedSize);
+	}
+	mapped = nullptr;
+	mappedSize = 0;
+	std::string().swap(buffer);
+	opened = false;
+}
+
+bool MappedFile::isOpen() const {
+	return opened;
+}
+
+std::string_view MappedFile::text() const {
+	if (mapped != nullptr) {
+		return std::string_view((const char *)mapped, mappedSize);
+	}
+	return buffer;
+}
+
+const uint8_t *MappedFile::data() const {
+	return (const uint8_t *)text().data();
+}
+
+size_t MappedFile::size() const {
+	return text().size();
+}
@@ -0,0 +1,40 @@
+#ifndef _mappedfile_hpp_
+#define _mappedfile_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Whole file contents as one read-only view.
+ * Regular files are mapped, pipes and other streams are read in large blocks into a buffer.
+ * The view stays valid until close() or the object is destroyed.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const;
+	std::string_view text() const;
+	const uint8_t *data() const;
+	size_t size() const;
+private:
+	bool readBlocks(int fd);
+
+	static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+	bool opened = false;
+	void *mapped = nullptr;
+	size_t mappedSize = 0;
+	std::string buffer;
+};
+
+#endif
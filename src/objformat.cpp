@@ -0,0 +1,677 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "objformat.hpp"
+
+namespace {
+
+const char *symbolTypeNames[] = { "local", "global", "extern" };
+const char *symbolKindNames[] = { "label", "section" };
+
+template<size_t N>
+uint8_t encodeName(const char *(&names)[N], const std::string& name) {
+	for (size_t i = 0; i < N; i++) {
+		if (name == names[i]) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+template<size_t N>
+const char *decodeName(const char *(&names)[N], uint8_t value) {
+	return value < N ? names[value] : names[0];
+}
+
+// the binary format knows R_16 and R_PC16 only
+uint8_t binaryType(uint8_t type) {
+	return (type == R_PC16) ? REL_PC16 : REL_16;
+}
+
+// every table cell is right aligned to ROW / 7 columns, longer text isn't cut
+constexpr size_t COLUMN = 20, ROW = 7 * COLUMN + 1;
+
+void appendColumn(std::string& text, std::string_view cell) {
+	if (cell.size() < COLUMN) {
+		text.append(COLUMN - cell.size(), ' ');
+	}
+	text.append(cell);
+}
+
+template<typename T>
+void appendNumber(std::string& text, T value) {
+	char digits[24];
+	auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+	text.append(digits, end - digits);
+}
+
+template<typename T>
+std::enable_if_t<std::is_integral_v<T>> appendColumn(std::string& text, T value) {
+	char digits[24];
+	auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+	appendColumn(text, std::string_view(digits, end - digits));
+}
+
+// the whole field or false, a text object may come from anywhere
+template<typename T>
+bool parseNumber(std::string_view field, T& value, int base = 10) {
+	auto end = field.data() + field.size();
+	auto parsed = std::from_chars(field.data(), end, value, base);
+	return parsed.ec == std::errc() && parsed.ptr == end;
+}
+
+// "00 " ... "ff ", one lookup per byte
+constexpr std::array<char, 256 * 3> buildHexTable() {
+	std::array<char, 256 * 3> table {};
+	constexpr char digits[] = "0123456789abcdef";
+	for (size_t i = 0; i < 256; i++) {
+		table[3 * i] = digits[i >> 4];
+		table[3 * i + 1] = digits[i & 0xf];
+		table[3 * i + 2] = ' ';
+	}
+	return table;
+}
+
+constexpr auto hexTable = buildHexTable();
+
+// 16 bytes per line, each followed by a space
+void appendHex(std::string& text, const uint8_t *bytes, size_t count) {
+	auto start = text.size();
+	text.resize(start + count * 3 + count / 16);
+	auto out = &text[start];
+	for (size_t i = 0; i < count; i++) {
+		memcpy(out, &hexTable[3 * bytes[i]], 3);
+		out += 3;
+		if ((i & 15) == 15) {
+			*out++ = '\n';
+		}
+	}
+}
+
+// section bytes with a "fill count value" line in place of every run
+void appendSection(std::string& text, const uint8_t *bytes, size_t size, const std::vector<fillRun>& fills) {
+	size_t position = 0, data = 0;
+	for (auto& run : fills) {
+		auto count = run.offset - position;
+		appendHex(text, bytes + data, count);
+		if (count % 16) {
+			text.push_back('\n');
+		}
+		text.append("fill ");
+		appendNumber(text, run.count);
+		text.push_back(' ');
+		text.append(&hexTable[3 * run.value], 2);
+		text.push_back('\n');
+		position = run.offset + run.count;
+		data += count;
+	}
+	appendHex(text, bytes + data, size - data);
+}
+
+size_t sectionTextSize(const objectSection& section, size_t size) {
+	return section.name.size() + 20 + size * 3 + size / 16 + 2 + section.fills.size() * 20;
+}
+
+void appendSectionText(std::string& text, const objectSection& section, const uint8_t *bytes, size_t size) {
+	text.push_back('.');
+	text.append(section.name);
+	text.push_back('\t');
+	appendNumber(text, section.size);
+	if (section.flags & SECTION_NOBITS) {
+		text.append("\tnobits");
+	}
+	text.push_back('\n');
+	appendSection(text, bytes, size, section.fills);
+	text.append("\n\n");
+}
+
+size_t tablesSize(const assemblyResult& result) {
+	size_t size = 4 * ROW;
+	for (auto& literal : result.literals) {
+		size += ROW + literal.entry.relocations.size() * 12;
+	}
+	size += result.symbols.size() * ROW;
+	for (auto& it : result.relocations) {
+		size += (it.relocations.size() + 3) * ROW;
+	}
+	return size;
+}
+
+// symbol table, equ literals and relocation tables
+void appendTables(const assemblyResult& result, std::string& text) {
+	text.append("%SYMBOL TABLE%\n");
+	appendColumn(text, "Symbol");
+	appendColumn(text, "Symbol number");
+	appendColumn(text, "Section");
+	appendColumn(text, "Offset");
+	appendColumn(text, "Type");
+	appendColumn(text, "Size");
+	appendColumn(text, "SymbolType");
+	text.push_back('\n');
+	for(auto& symbol : result.symbols) {
+		appendColumn(text, symbol.name);
+		appendColumn(text, symbol.entry.number);
+		appendColumn(text, symbol.section);
+		appendColumn(text, symbol.entry.offset);
+		appendColumn(text, decodeName(symbolTypeNames, symbol.entry.type));
+		appendColumn(text, symbol.entry.size);
+		appendColumn(text, decodeName(symbolKindNames, symbol.entry.symbolType));
+		text.push_back('\n');
+	}
+	text.push_back('\n');
+
+	text.append("%EQU SYMBOLS%\n");
+	appendColumn(text, "Symbol");
+	appendColumn(text, "Value");
+	appendColumn(text, "Relocations");
+	text.push_back('\n');
+	std::string relocations;
+	for(auto& literal : result.literals) {
+		appendColumn(text, literal.name);
+		appendColumn(text, literal.entry.value);
+		relocations.clear();
+		for(auto& reloc : literal.entry.relocations) {
+			relocations.push_back(reloc.op);
+			appendNumber(relocations, reloc.symbolNumber);
+			relocations.push_back(' ');
+		}
+		appendColumn(text, relocations);
+		text.push_back('\n');
+	}
+
+	text.push_back('\n');
+
+	for(auto& it : result.relocations) {
+		appendColumn(text, "%RELOCATION TABLE% - section ");
+		appendColumn(text, it.section);
+		text.push_back('\n');
+		appendColumn(text, "Symbol number");
+		appendColumn(text, "Offset");
+		appendColumn(text, "Operation");
+		appendColumn(text, "Relocation type");
+		text.push_back('\n');
+		for(auto& reloc : it.relocations) {
+			appendColumn(text, reloc.value);
+			appendColumn(text, reloc.offset);
+			appendColumn(text, std::string_view(&reloc.op, 1));
+			appendColumn(text, decodeName(relocationTypeNames, reloc.type));
+			text.push_back('\n');
+		}
+		text.push_back('\n');
+	}
+	text.push_back('\n');
+}
+
+uint32_t align4(uint32_t value) {
+	return (value + 3) & ~3u;
+}
+
+template<typename T>
+void appendRecords(std::vector<uint8_t>& buffer, uint32_t offset, const std::vector<T>& records) {
+	if (!records.empty()) {
+		memcpy(&buffer[offset], records.data(), records.size() * sizeof(T));
+	}
+}
+
+}
+
+void ObjectFormat::writeText(const assemblyResult& result, std::ostream& objectFile) {
+	std::string text;
+	formatText(result, text);
+	objectFile.write(text.data(), text.size());
+}
+
+void ObjectFormat::formatText(const assemblyResult& result, std::string& text) {
+	// exact for the section dumps, the tables are estimated at a full row per entry
+	auto size = tablesSize(result);
+	for (auto& it : result.sections) {
+		size += sectionTextSize(it, it.bytes.size());
+	}
+	text.clear();
+	text.reserve(size);
+	appendTables(result, text);
+	for (auto& it : result.sections) {
+		appendSectionText(text, it, it.bytes.data(), it.bytes.size());
+	}
+}
+
+bool ObjectFormat::writeText(const assemblyResult& result, std::ostream& out, const sectionSource& source) {
+	std::string text;
+	text.reserve(tablesSize(result));
+	appendTables(result, text);
+	out.write(text.data(), text.size());
+	std::vector<uint8_t> bytes;
+	for (size_t i = 0; i < result.sections.size(); i++) {
+		if (!source.read(i, bytes)) {
+			return false;
+		}
+		text.clear();
+		appendSectionText(text, result.sections[i], bytes.data(), bytes.size());
+		out.write(text.data(), text.size());
+	}
+	return true;
+}
+
+bool ObjectFormat::readText(std::istream& in, assemblyResult& result) {
+	enum { NONE, SYMBOLS, LITERALS, RELOCATIONS, SECTION } state = NONE;
+	std::unordered_map<std::string, uint32_t> sectionNumbers = { { "UNDEFINED", UNDEFINED_SECTION } };
+	std::string line;
+	uint32_t filled = 0;	// run bytes of the current section
+
+	result = assemblyResult();
+	result.success = true;
+	while (std::getline(in, line)) {
+		if (line == "") {
+			if (state != SECTION) {
+				state = NONE;
+			}
+			continue;
+		}
+		std::stringstream parser(line);
+		if (line == "%SYMBOL TABLE%" || line == "%EQU SYMBOLS%") {
+			state = (line[1] == 'S') ? SYMBOLS : LITERALS;
+			std::getline(in, line);
+			continue;
+		}
+		if (line.compare(0, 18, "%RELOCATION TABLE%") == 0) {
+			std::string word, section;
+			while (parser >> word) {
+				section = word;
+			}
+			result.relocations.push_back( { section, { } });
+			state = RELOCATIONS;
+			std::getline(in, line);
+			continue;
+		}
+		if (line[0] == '.' && line.find('\t') != std::string::npos) {
+			auto tab = line.find('\t');
+			objectSection section;
+			section.name = line.substr(1, tab - 1);
+			section.number = 0;
+			auto end = std::min(line.find('\t', tab + 1), line.size());
+			if (!parseNumber(std::string_view(line).substr(tab + 1, end - tab - 1), section.size)) {
+				return false;
+			}
+			section.flags = (line.find("nobits", tab) != std::string::npos) ? SECTION_NOBITS : 0;
+			result.sections.push_back(section);
+			filled = 0;
+			state = SECTION;
+			continue;
+		}
+
+		switch (state) {
+		case SYMBOLS: {
+			objectSymbol symbol;
+			uint32_t number;
+			int offset, size;
+			std::string type, symbolType;
+			if (!(parser >> symbol.name >> number >> symbol.section >> offset >> type >> size >> symbolType)) {
+				return false;
+			}
+			symbol.entry.number = number;
+			symbol.entry.offset = offset;
+			symbol.entry.type = encodeName(symbolTypeNames, type);
+			symbol.entry.size = size;
+			symbol.entry.symbolType = encodeName(symbolKindNames, symbolType);
+			if (symbol.entry.symbolType == SYM_SECTION) {
+				sectionNumbers[symbol.name] = number;
+			}
+			result.symbols.push_back(symbol);
+		}
+			break;
+
+		case LITERALS: {
+			objectLiteral literal;
+			int value;
+			if (!(parser >> literal.name >> value)) {
+				return false;
+			}
+			literal.entry.value = value;
+			std::string relocation;
+			while (parser >> relocation) {
+				if (relocation.size() < 2 || (relocation[0] != ADD && relocation[0] != SUB)) {
+					return false;
+				}
+				uint32_t symbol;
+				if (!parseNumber(std::string_view(relocation).substr(1), symbol)) {
+					return false;
+				}
+				literal.entry.relocations.push_back( { symbol, relocation[0], R_16 });
+			}
+			result.literals.push_back(literal);
+		}
+			break;
+
+		case RELOCATIONS: {
+			relocationEntry relocation;
+			uint32_t value;
+			int offset;
+			std::string type;
+			if (!(parser >> value >> offset >> relocation.op >> type)) {
+				return false;
+			}
+			relocation.value = value;
+			relocation.offset = offset;
+			relocation.type = encodeName(relocationTypeNames, type);
+			result.relocations.back().relocations.push_back(relocation);
+		}
+			break;
+
+		case SECTION: {
+			auto& section = result.sections.back();
+			std::string byte;
+			while (parser >> byte) {
+				if (byte == "fill") {
+					uint32_t count;
+					uint8_t value;
+					if (!(parser >> count >> byte) || !parseNumber(byte, value, 16)) {
+						return false;
+					}
+					section.fills.push_back( { (uint32_t)section.bytes.size() + filled, count, value });
+					filled += count;
+					continue;
+				}
+				uint8_t value;
+				if (!parseNumber(byte, value, 16)) {
+					return false;
+				}
+				section.bytes.push_back(value);
+			}
+		}
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	for (auto& symbol : result.symbols) {
+		symbol.entry.sectionNumber = sectionNumbers[symbol.section];
+	}
+	for (auto& section : result.sections) {
+		section.number = sectionNumbers[section.name];
+	}
+	return true;
+}
+
+void ObjectFormat::writeBinary(const assemblyResult& result, std::ostream& out) {
+	writeBinary(result, out, nullptr);
+}
+
+bool ObjectFormat::writeBinary(const assemblyResult& result, std::ostream& out, const sectionSource& source) {
+	return writeBinary(result, out, &source);
+}
+
+// without a source the section bytes are the ones in the result
+bool ObjectFormat::writeBinary(const assemblyResult& result, std::ostream& out, const sectionSource *source) {
+	std::string strings(1, '\0');
+	std::unordered_map<std::string, uint32_t> stringOffsets;
+	auto addString = [&](const std::string& str) -> uint32_t {
+		if (str == "") {
+			return 0;
+		}
+		auto it = stringOffsets.find(str);
+		if (it != stringOffsets.end()) {
+			return it->second;
+		}
+		uint32_t offset = strings.size();
+		strings.append(str).push_back('\0');
+		stringOffsets.insert( { str, offset });
+		return offset;
+	};
+
+	std::vector<binarySymbol> symbols;
+	for (auto& symbol : result.symbols) {
+		symbols.push_back( { addString(symbol.name), symbol.entry.number, symbol.entry.sectionNumber, symbol.entry.offset,
+				symbol.entry.size, symbol.entry.type, symbol.entry.symbolType, 0 });
+	}
+
+	std::vector<binaryLiteral> literals;
+	std::vector<binaryLiteralRelocation> literalRelocations;
+	for (auto& literal : result.literals) {
+		literals.push_back( { addString(literal.name), literal.entry.value, 0, (uint32_t)literalRelocations.size(),
+				(uint32_t)literal.entry.relocations.size() });
+		for (auto& relocation : literal.entry.relocations) {
+			literalRelocations.push_back( { relocation.symbolNumber, (uint8_t)relocation.op, binaryType(relocation.type), 0 });
+		}
+	}
+
+	std::vector<binaryRelocationTable> relocationTables;
+	std::vector<binaryRelocation> relocations;
+	for (auto& table : result.relocations) {
+		relocationTables.push_back( { addString(table.section), (uint32_t)relocations.size(), (uint32_t)table.relocations.size() });
+		for (auto& relocation : table.relocations) {
+			relocations.push_back( { relocation.value, relocation.offset, (uint8_t)relocation.op, binaryType(relocation.type) });
+		}
+	}
+
+	std::vector<binarySection> sections;
+	std::vector<binaryFill> fills;
+	for (size_t i = 0; i < result.sections.size(); i++) {
+		auto& section = result.sections[i];
+		auto dataSize = (source != nullptr) ? source->size(i) : section.bytes.size();
+		sections.push_back( { addString(section.name), section.number, 0, (uint32_t)dataSize, section.size,
+				section.flags, (uint32_t)fills.size(), (uint32_t)section.fills.size() });
+		for (auto& run : section.fills) {
+			fills.push_back( { run.offset, run.count, run.value, { } });
+		}
+	}
+
+	binaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, OBJ_MAGIC, sizeof(OBJ_MAGIC));
+	header.version = OBJ_VERSION;
+	uint32_t offset = sizeof(header);
+	header.stringTableOffset = offset;
+	header.stringTableSize = strings.size();
+	offset = align4(offset + strings.size());
+	header.symbolOffset = offset;
+	header.symbolCount = symbols.size();
+	offset += symbols.size() * sizeof(binarySymbol);
+	header.literalOffset = offset;
+	header.literalCount = literals.size();
+	offset += literals.size() * sizeof(binaryLiteral);
+	header.literalRelocationOffset = offset;
+	header.literalRelocationCount = literalRelocations.size();
+	offset += literalRelocations.size() * sizeof(binaryLiteralRelocation);
+	header.relocationTableOffset = offset;
+	header.relocationTableCount = relocationTables.size();
+	offset += relocationTables.size() * sizeof(binaryRelocationTable);
+	header.relocationOffset = offset;
+	header.relocationCount = relocations.size();
+	offset += relocations.size() * sizeof(binaryRelocation);
+	header.sectionOffset = offset;
+	header.sectionCount = sections.size();
+	offset += sections.size() * sizeof(binarySection);
+	header.fillOffset = offset;
+	header.fillCount = fills.size();
+	offset += fills.size() * sizeof(binaryFill);
+	auto tables = offset;
+	for (auto& section : sections) {
+		section.dataOffset = offset;
+		offset = align4(offset + section.dataSize);
+	}
+	header.fileSize = offset;
+
+	// the tables in one block, then the bytes of one section at a time
+	std::vector<uint8_t> buffer(tables, 0);
+	memcpy(&buffer[0], &header, sizeof(header));
+	memcpy(&buffer[header.stringTableOffset], strings.data(), strings.size());
+	appendRecords(buffer, header.symbolOffset, symbols);
+	appendRecords(buffer, header.literalOffset, literals);
+	appendRecords(buffer, header.literalRelocationOffset, literalRelocations);
+	appendRecords(buffer, header.relocationTableOffset, relocationTables);
+	appendRecords(buffer, header.relocationOffset, relocations);
+	appendRecords(buffer, header.sectionOffset, sections);
+	appendRecords(buffer, header.fillOffset, fills);
+	out.write((const char *)buffer.data(), buffer.size());
+	static constexpr char padding[4] = { };
+	for (size_t i = 0; i < sections.size(); i++) {
+		auto bytes = result.sections[i].bytes.data();
+		if (source != nullptr) {
+			if (!source->read(i, buffer)) {
+				return false;
+			}
+			bytes = buffer.data();
+		}
+		out.write((const char *)bytes, sections[i].dataSize);
+		out.write(padding, align4(sections[i].dataSize) - sections[i].dataSize);
+	}
+	return true;
+}
+
+bool ObjectFormat::isBinary(const uint8_t *data, size_t size) {
+	return size >= sizeof(OBJ_MAGIC) && memcmp(data, OBJ_MAGIC, sizeof(OBJ_MAGIC)) == 0;
+}
+
+template<typename T>
+const T *BinaryObject::table(uint32_t offset) const {
+	return reinterpret_cast<const T *>(data + offset);
+}
+
+bool BinaryObject::open(const uint8_t *data, size_t size) {
+	this->data = data;
+	this->size = size;
+	if (size < sizeof(binaryHeader) || !ObjectFormat::isBinary(data, size) || (uintptr_t)data % 4) {
+		return false;
+	}
+	auto& h = header();
+	if (h.version != OBJ_VERSION || h.fileSize > size) {
+		return false;
+	}
+	auto fits = [&](uint64_t offset, uint64_t count, uint64_t recordSize) {
+		return offset % 4 == 0 && offset + count * recordSize <= h.fileSize;
+	};
+	if (h.stringTableSize == 0 || h.stringTableOffset + (uint64_t)h.stringTableSize > h.fileSize
+			|| data[h.stringTableOffset + h.stringTableSize - 1] != '\0'
+			|| !fits(h.symbolOffset, h.symbolCount, sizeof(binarySymbol))
+			|| !fits(h.literalOffset, h.literalCount, sizeof(binaryLiteral))
+			|| !fits(h.literalRelocationOffset, h.literalRelocationCount, sizeof(binaryLiteralRelocation))
+			|| !fits(h.relocationTableOffset, h.relocationTableCount, sizeof(binaryRelocationTable))
+			|| !fits(h.relocationOffset, h.relocationCount, sizeof(binaryRelocation))
+			|| !fits(h.sectionOffset, h.sectionCount, sizeof(binarySection))
+			|| !fits(h.fillOffset, h.fillCount, sizeof(binaryFill))) {
+		return false;
+	}
+	for (uint32_t i = 0; i < h.literalCount; i++) {
+		if ((uint64_t)literals()[i].firstRelocation + literals()[i].relocationCount > h.literalRelocationCount) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < h.relocationTableCount; i++) {
+		if ((uint64_t)relocationTables()[i].firstRelocation + relocationTables()[i].relocationCount > h.relocationCount) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < h.sectionCount; i++) {
+		if ((uint64_t)sections()[i].dataOffset + sections()[i].dataSize > h.fileSize
+				|| (uint64_t)sections()[i].firstFill + sections()[i].fillCount > h.fillCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const binaryHeader& BinaryObject::header() const {
+	return *table<binaryHeader>(0);
+}
+
+std::string_view BinaryObject::string(uint32_t offset) const {
+	if (offset >= header().stringTableSize) {
+		return std::string_view();
+	}
+	return std::string_view((const char *)data + header().stringTableOffset + offset);
+}
+
+const binarySymbol *BinaryObject::symbols() const {
+	return table<binarySymbol>(header().symbolOffset);
+}
+
+const binaryLiteral *BinaryObject::literals() const {
+	return table<binaryLiteral>(header().literalOffset);
+}
+
+const binaryLiteralRelocation *BinaryObject::literalRelocations() const {
+	return table<binaryLiteralRelocation>(header().literalRelocationOffset);
+}
+
+const binaryRelocationTable *BinaryObject::relocationTables() const {
+	return table<binaryRelocationTable>(header().relocationTableOffset);
+}
+
+const binaryRelocation *BinaryObject::relocations() const {
+	return table<binaryRelocation>(header().relocationOffset);
+}
+
+const binarySection *BinaryObject::sections() const {
+	return table<binarySection>(header().sectionOffset);
+}
+
+const binaryFill *BinaryObject::fills() const {
+	return table<binaryFill>(header().fillOffset);
+}
+
+const uint8_t *BinaryObject::sectionData(const binarySection& section) const {
+	return data + section.dataOffset;
+}
+
+assemblyResult BinaryObject::toResult() const {
+	assemblyResult result;
+	result.success = true;
+	auto& h = header();
+
+	std::unordered_map<uint32_t, std::string> sectionNames = { { UNDEFINED_SECTION, "UNDEFINED" } };
+	for (uint32_t i = 0; i < h.sectionCount; i++) {
+		sectionNames[sections()[i].number] = std::string(string(sections()[i].name));
+	}
+
+	for (uint32_t i = 0; i < h.symbolCount; i++) {
+		auto& symbol = symbols()[i];
+		symbolTableEntry entry = { symbol.number, symbol.sectionNumber, symbol.offset,
+				symbol.type, symbol.size, symbol.symbolType };
+		result.symbols.push_back( { std::string(string(symbol.name)), sectionNames[symbol.sectionNumber], entry });
+	}
+
+	for (uint32_t i = 0; i < h.literalCount; i++) {
+		auto& literal = literals()[i];
+		objectLiteral entry;
+		entry.name = std::string(string(literal.name));
+		entry.entry.value = literal.value;
+		for (uint32_t j = 0; j < literal.relocationCount; j++) {
+			auto& relocation = literalRelocations()[literal.firstRelocation + j];
+			entry.entry.relocations.push_back( { relocation.symbolNumber, (char)relocation.op,
+					(relocation.type == REL_PC16) ? R_PC16 : R_16 });
+		}
+		result.literals.push_back(entry);
+	}
+
+	for (uint32_t i = 0; i < h.relocationTableCount; i++) {
+		auto& table = relocationTables()[i];
+		objectRelocations entry;
+		entry.section = std::string(string(table.section));
+		for (uint32_t j = 0; j < table.relocationCount; j++) {
+			auto& relocation = relocations()[table.firstRelocation + j];
+			entry.relocations.push_back( { relocation.offset, (relocation.type == REL_PC16) ? R_PC16 : R_16,
+					(char)relocation.op, relocation.value });
+		}
+		result.relocations.push_back(entry);
+	}
+
+	for (uint32_t i = 0; i < h.sectionCount; i++) {
+		auto& section = sections()[i];
+		auto bytes = sectionData(section);
+		std::vector<fillRun> runs;
+		for (uint32_t j = 0; j < section.fillCount; j++) {
+			auto& run = fills()[section.firstFill + j];
+			runs.push_back( { run.offset, run.count, run.value });
+		}
+		result.sections.push_back( { std::string(string(section.name)), section.number, section.size,
+				std::vector<uint8_t>(bytes, bytes + section.dataSize), runs, section.flags });
+	}
+	return result;
+}
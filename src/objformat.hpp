@@ -0,0 +1,168 @@
+#ifndef _objformat_hpp_
+#define _objformat_hpp_
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "auxiliary.hpp"
+
+static constexpr auto OBJ_TEXT = 0, OBJ_BIN = 1;
+
+/*
+ * Binary object format, every field little endian.
+ *
+ * | header | string table | symbols | literals | literal relocations | relocation tables | relocations | sections | fills | section data |
+ *
+ * All records have fixed size and 4 byte alignment and are addressed by offsets in the header,
+ * so a mapped file can be read in place. Names are offsets into the string table of
+ * NUL terminated strings, offset 0 is the empty string.
+ */
+static constexpr char OBJ_MAGIC[4] = { 'O', 'P', 'A', 'O' };
+static constexpr uint16_t OBJ_VERSION = 2;
+
+static constexpr uint8_t REL_16 = 0, REL_PC16 = 1;
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t flags;
+	uint32_t fileSize;
+	uint32_t stringTableOffset, stringTableSize;
+	uint32_t symbolOffset, symbolCount;
+	uint32_t literalOffset, literalCount;
+	uint32_t literalRelocationOffset, literalRelocationCount;
+	uint32_t relocationTableOffset, relocationTableCount;
+	uint32_t relocationOffset, relocationCount;
+	uint32_t sectionOffset, sectionCount;
+	uint32_t fillOffset, fillCount;
+	uint32_t reserved;
+} binaryHeader;
+
+typedef struct {
+	uint32_t name;
+	uint32_t number;
+	uint32_t sectionNumber;
+	uint16_t offset;
+	uint16_t size;
+	uint8_t type;
+	uint8_t symbolType;
+	uint16_t reserved;
+} binarySymbol;
+
+typedef struct {
+	uint32_t name;
+	int16_t value;
+	uint16_t reserved;
+	uint32_t firstRelocation;	// index into literal relocations
+	uint32_t relocationCount;
+} binaryLiteral;
+
+typedef struct {
+	uint32_t symbolNumber;
+	uint8_t op;
+	uint8_t type;
+	uint16_t reserved;
+} binaryLiteralRelocation;
+
+typedef struct {
+	uint32_t section;	// section name
+	uint32_t firstRelocation;	// index into relocations
+	uint32_t relocationCount;
+} binaryRelocationTable;
+
+typedef struct {
+	uint32_t value;	// section/symbol number
+	uint16_t offset;
+	uint8_t op;
+	uint8_t type;
+} binaryRelocation;
+
+typedef struct {
+	uint32_t name;
+	uint32_t number;
+	uint32_t dataOffset;	// from the start of the file
+	uint32_t dataSize;	// stored bytes, without the fill runs
+	uint16_t size;
+	uint16_t flags;	// SECTION_NOBITS
+	uint32_t firstFill;	// index into fills
+	uint32_t fillCount;
+} binarySection;
+
+typedef struct {
+	uint32_t offset;	// in the section
+	uint32_t count;
+	uint8_t value;
+	uint8_t reserved[3];
+} binaryFill;
+
+static_assert(sizeof(binaryHeader) == 80, "binary object header layout");
+static_assert(sizeof(binarySymbol) == 20, "binary symbol layout");
+static_assert(sizeof(binaryLiteral) == 16, "binary literal layout");
+static_assert(sizeof(binaryLiteralRelocation) == 8, "binary literal relocation layout");
+static_assert(sizeof(binaryRelocationTable) == 12, "binary relocation table layout");
+static_assert(sizeof(binaryRelocation) == 8, "binary relocation layout");
+static_assert(sizeof(binarySection) == 28, "binary section layout");
+static_assert(sizeof(binaryFill) == 12, "binary fill layout");
+
+/*
+ * Stored bytes of the sections of a result that leaves them empty (asm --spill),
+ * by index into result.sections. The writers read one section at a time.
+ */
+typedef struct {
+	std::function<size_t(size_t section)> size;
+	std::function<bool(size_t section, std::vector<uint8_t>& bytes)> read;
+} sectionSource;
+
+class ObjectFormat {
+public:
+	// %SYMBOL TABLE% text format
+	static void writeText(const assemblyResult& result, std::ostream& out);
+	// section bytes from source, false if it couldn't read them
+	static bool writeText(const assemblyResult& result, std::ostream& out, const sectionSource& source);
+	// the same text in memory, text is cleared and sized once
+	static void formatText(const assemblyResult& result, std::string& text);
+	static bool readText(std::istream& in, assemblyResult& result);
+
+	static void writeBinary(const assemblyResult& result, std::ostream& out);
+	static bool writeBinary(const assemblyResult& result, std::ostream& out, const sectionSource& source);
+
+	static bool isBinary(const uint8_t *data, size_t size);
+private:
+	static bool writeBinary(const assemblyResult& result, std::ostream& out, const sectionSource *source);
+};
+
+/*
+ * Read-only view of a binary object, works on a buffer or a mapped file without copying it.
+ * Records are accessed in place, this requires a little endian host.
+ */
+class BinaryObject {
+public:
+	// checks magic, version and that every table lies inside the buffer
+	bool open(const uint8_t *data, size_t size);
+
+	const binaryHeader& header() const;
+	std::string_view string(uint32_t offset) const;
+
+	const binarySymbol *symbols() const;
+	const binaryLiteral *literals() const;
+	const binaryLiteralRelocation *literalRelocations() const;
+	const binaryRelocationTable *relocationTables() const;
+	const binaryRelocation *relocations() const;
+	const binarySection *sections() const;
+	const binaryFill *fills() const;
+	const uint8_t *sectionData(const binarySection& section) const;
+
+	// copies the object into the same model the assembler produces
+	assemblyResult toResult() const;
+private:
+	template<typename T>
+	const T *table(uint32_t offset) const;
+
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+};
+
+#endif
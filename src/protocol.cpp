@@ -0,0 +1,104 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "protocol.hpp"
+
+namespace {
+
+// headers are a few lines, anything longer isn't a client of ours
+constexpr size_t HEADER_LIMIT = 1 << 16;
+// sources and objects, a larger length is refused before any of the body is read
+constexpr size_t MAX_BODY = 1 << 30;
+constexpr size_t BLOCK_SIZE = 1 << 16;
+
+bool writeAll(int fd, const char *data, size_t size) {
+	while (size) {
+		// a client that went away is a failed write, not SIGPIPE
+		auto count = send(fd, data, size, MSG_NOSIGNAL);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+}
+
+bool readMessage(int fd, protocolMessage& message) {
+	message.fields.clear();
+	message.body.clear();
+	std::string buffer;
+	size_t headerEnd = std::string::npos;
+	char block[BLOCK_SIZE];
+	while (headerEnd == std::string::npos) {
+		auto count = read(fd, block, sizeof(block));
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0 || buffer.size() > HEADER_LIMIT) {
+			return false;
+		}
+		buffer.append(block, count);
+		headerEnd = buffer.find("\n\n");
+	}
+
+	size_t position = 0;
+	while (position < headerEnd) {
+		auto end = buffer.find('\n', position);
+		auto line = std::string_view(buffer).substr(position, end - position);
+		auto space = line.find(' ');
+		if (space == std::string_view::npos) {
+			message.set(std::string(line), "");
+		} else {
+			message.set(std::string(line.substr(0, space)), std::string(line.substr(space + 1)));
+		}
+		position = end + 1;
+	}
+
+	size_t length = 0;
+	auto lengthField = message.get("length");
+	if (lengthField != "") {
+		if (lengthField.find_first_not_of("0123456789") != std::string::npos || lengthField.size() > 12) {
+			return false;
+		}
+		length = std::stoull(lengthField);
+	}
+	if (length > MAX_BODY) {
+		return false;
+	}
+	message.body = buffer.substr(headerEnd + 2);
+	if (message.body.size() > length) {
+		return false;
+	}
+	// the body grows with what arrives, not with what the length promises
+	while (message.body.size() < length) {
+		auto count = read(fd, block, std::min(sizeof(block), length - message.body.size()));
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		message.body.append(block, count);
+	}
+	return true;
+}
+
+bool writeMessage(int fd, const protocolMessage& message) {
+	std::string header;
+	for (auto& field : message.fields) {
+		if (field.first != "length") {
+			header += field.first + " " + field.second + "\n";
+		}
+	}
+	header += "length " + std::to_string(message.body.size()) + "\n\n";
+	return writeAll(fd, header.data(), header.size()) && writeAll(fd, message.body.data(), message.body.size());
+}
@@ -0,0 +1,43 @@
+#ifndef _protocol_hpp_
+#define _protocol_hpp_
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Messages between the assembler server (asm --server) and its clients, one request
+ * and one response per connection:
+ *
+ * key value\n ... \n body
+ *
+ * "length" gives the size of the body. Requests start with "command assemble|stats|shutdown",
+ * an assemble request names a "source" path or carries the source in the body, an "output"
+ * path or none to get the object back in the body of the response, "optimize size" for -Os. Responses carry "status",
+ * "latency" (microseconds from accept to the response), "queue" (connections ahead of this one)
+ * and "messages", the size of the diagnostics at the start of the body.
+ */
+typedef struct {
+	std::vector<std::pair<std::string, std::string>> fields;
+	std::string body;
+
+	void set(std::string key, std::string value) {
+		fields.emplace_back(key, value);
+	}
+	// empty if the field isn't there
+	std::string get(std::string_view key) const {
+		for (auto& field : fields) {
+			if (field.first == key) {
+				return field.second;
+			}
+		}
+		return "";
+	}
+} protocolMessage;
+
+// false on a closed or broken connection or a malformed header
+bool readMessage(int fd, protocolMessage& message);
+bool writeMessage(int fd, const protocolMessage& message);
+
+#endif
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstring>
+
+#include "sectionbuffer.hpp"
+
+uint8_t* ChunkArena::acquire() {
+	if (free.empty()) {
+		owned.emplace_back(new uint8_t[CHUNK_SIZE]);
+		return owned.back().get();
+	}
+	auto chunk = free.back();
+	free.pop_back();
+	return chunk;
+}
+
+void ChunkArena::release(uint8_t *chunk) {
+	free.push_back(chunk);
+}
+
+SectionBuffer::SectionBuffer(ChunkArena *arena) : arena(arena) {
+}
+
+SectionBuffer::~SectionBuffer() {
+	clear();
+}
+
+SectionBuffer::SectionBuffer(SectionBuffer&& other) noexcept {
+	arena = other.arena;
+	chunks.swap(other.chunks);
+	current = other.current;
+	cursor = other.cursor;
+	limit = other.limit;
+	runs.swap(other.runs);
+	filledThrough.swap(other.filledThrough);
+	filled = other.filled;
+	other.current = other.filled = 0;
+	other.cursor = other.limit = nullptr;
+}
+
+SectionBuffer& SectionBuffer::operator=(SectionBuffer&& other) noexcept {
+	if (this != &other) {
+		clear();
+		arena = other.arena;
+		chunks.swap(other.chunks);
+		current = other.current;
+		cursor = other.cursor;
+		limit = other.limit;
+		runs.swap(other.runs);
+		filledThrough.swap(other.filledThrough);
+		filled = other.filled;
+		other.current = other.filled = 0;
+		other.cursor = other.limit = nullptr;
+	}
+	return *this;
+}
+
+void SectionBuffer::reserveChunks(size_t count) {
+	while (chunks.size() < count) {
+		chunks.push_back(arena->acquire());
+	}
+}
+
+void SectionBuffer::nextChunk() {
+	if (cursor != nullptr) {
+		current++;
+	}
+	reserveChunks(current + 1);
+	cursor = chunks[current];
+	limit = cursor + ChunkArena::CHUNK_SIZE;
+}
+
+void SectionBuffer::append(const uint8_t *bytes, size_t count) {
+	while (count) {
+		if (cursor == limit) {
+			nextChunk();
+		}
+		auto part = std::min<size_t>(count, limit - cursor);
+		std::memcpy(cursor, bytes, part);
+		cursor += part;
+		bytes += part;
+		count -= part;
+	}
+}
+
+void SectionBuffer::fill(uint8_t byte, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	auto offset = size();
+	filled += count;
+	// a run right after a run of the same byte grows it
+	if (!runs.empty() && runs.back().value == byte && runs.back().offset + runs.back().count == offset) {
+		runs.back().count += count;
+		filledThrough.back() = filled;
+		return;
+	}
+	runs.push_back( { (uint32_t)offset, (uint32_t)count, byte });
+	filledThrough.push_back(filled);
+}
+
+size_t SectionBuffer::dataSize() const {
+	if (cursor == nullptr) {
+		return 0;
+	}
+	return (current << ChunkArena::CHUNK_BITS) + (cursor - chunks[current]);
+}
+
+size_t SectionBuffer::dataOffset(size_t offset) const {
+	// last run starting at or before offset
+	auto run = std::upper_bound(runs.begin(), runs.end(), offset, [](size_t value, const fillRun& run) {
+		return value < run.offset;
+	});
+	if (run == runs.begin()) {
+		return offset;
+	}
+	--run;
+	if (offset < run->offset + run->count) {
+		return IN_RUN;
+	}
+	return offset - filledThrough[run - runs.begin()];
+}
+
+std::vector<uint8_t> SectionBuffer::bytes() const {
+	std::vector<uint8_t> out(dataSize());
+	for (size_t offset = 0; offset < out.size(); offset += ChunkArena::CHUNK_SIZE) {
+		auto part = std::min(ChunkArena::CHUNK_SIZE, out.size() - offset);
+		std::memcpy(out.data() + offset, chunks[offset >> ChunkArena::CHUNK_BITS], part);
+	}
+	return out;
+}
+
+void SectionBuffer::clear() {
+	release();
+	runs.clear();
+	filledThrough.clear();
+	filled = 0;
+}
+
+void SectionBuffer::release() {
+	for (auto chunk : chunks) {
+		arena->release(chunk);
+	}
+	chunks.clear();
+	current = 0;
+	cursor = limit = nullptr;
+}
@@ -0,0 +1,105 @@
+#ifndef _sectionbuffer_hpp_
+#define _sectionbuffer_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// count bytes of value starting at offset, they take no space in the section bytes
+typedef struct {
+	uint32_t offset;	// in the section, earlier runs included
+	uint32_t count;
+	uint8_t value;
+} fillRun;
+
+/*
+ * Fixed-size chunks shared by the section buffers of one assembler.
+ * Released chunks are kept and handed out again, a reused assembler stops allocating for code.
+ */
+class ChunkArena {
+public:
+	static constexpr size_t CHUNK_BITS = 12;
+	static constexpr size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+	uint8_t* acquire();
+	void release(uint8_t *chunk);
+private:
+	std::vector<std::unique_ptr<uint8_t[]>> owned;
+	std::vector<uint8_t*> free;
+};
+
+/*
+ * Machine code of one section. Appending never moves bytes already written,
+ * patching by offset is a shift and a mask. Filled regions are kept as runs,
+ * offsets count them, the stored bytes don't.
+ */
+class SectionBuffer {
+public:
+	explicit SectionBuffer(ChunkArena *arena);
+	~SectionBuffer();
+
+	SectionBuffer(SectionBuffer&& other) noexcept;
+	SectionBuffer& operator=(SectionBuffer&& other) noexcept;
+	SectionBuffer(const SectionBuffer&) = delete;
+	SectionBuffer& operator=(const SectionBuffer&) = delete;
+
+	void push(uint8_t byte) {
+		if (cursor == limit) {
+			nextChunk();
+		}
+		*cursor++ = byte;
+	}
+
+	void append(const uint8_t *bytes, size_t count);
+	void fill(uint8_t byte, size_t count);
+
+	// offsets past size() land in a chunk of their own and are not part of the output, neither do offsets in a run
+	uint8_t& operator[](size_t offset) {
+		if (!runs.empty()) {
+			offset = dataOffset(offset);
+			if (offset == IN_RUN) {
+				return discard;
+			}
+		}
+		auto chunk = offset >> ChunkArena::CHUNK_BITS;
+		if (chunk >= chunks.size()) {
+			reserveChunks(chunk + 1);
+		}
+		return chunks[chunk][offset & (ChunkArena::CHUNK_SIZE - 1)];
+	}
+
+	// bytes and runs
+	size_t size() const {
+		return dataSize() + filled;
+	}
+	size_t dataSize() const;
+	// stored bytes only, runs are in fills()
+	std::vector<uint8_t> bytes() const;
+	const std::vector<fillRun>& fills() const {
+		return runs;
+	}
+	// returns the chunks to the arena
+	void clear();
+	// returns the chunks to the arena but keeps the runs, for bytes moved elsewhere (SpillFile)
+	void release();
+
+	static constexpr size_t IN_RUN = SIZE_MAX;
+	// offset among the stored bytes, IN_RUN for an offset in a run
+	size_t dataOffset(size_t offset) const;
+private:
+	void nextChunk();
+	void reserveChunks(size_t count);
+
+	ChunkArena *arena;
+	std::vector<uint8_t*> chunks;
+	size_t current = 0;	// chunk the cursor is in
+	uint8_t *cursor = nullptr, *limit = nullptr;
+
+	std::vector<fillRun> runs;
+	std::vector<size_t> filledThrough;	// run bytes up to the end of each run
+	size_t filled = 0;
+	uint8_t discard = 0;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "mappedfile.hpp"
+#include "sectioncache.hpp"
+
+namespace {
+
+/*
+ * | header | text | name bytes | names | backpatch | relocations | fills | section bytes |
+ *
+ * Records are copied out with memcpy, no alignment is needed. Host byte order, a cache
+ * directory isn't meant to move between machines.
+ */
+constexpr char CACHE_MAGIC[4] = { 'O', 'P', 'A', 'C' };
+constexpr uint16_t CACHE_VERSION = 3;
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t flags;
+	uint32_t sectionNumber;
+	uint32_t symbolsBefore, symbolsAfter;
+	uint32_t lines;
+	uint16_t size;
+	uint16_t reserved;
+	uint32_t textSize;
+	uint32_t nameBytes, nameCount;
+	uint32_t backpatchCount, relocationCount, fillCount;
+	uint32_t dataSize;
+	uint64_t macros;
+	uint32_t expansionsBefore, expansionsAfter;
+	uint32_t lineTypes[numberOfRegex];
+} cacheHeader;
+
+typedef struct {
+	uint32_t number;
+	uint32_t sectionNumber;
+	uint16_t offset;
+	uint16_t size;
+	uint8_t type;
+	uint8_t symbolType;
+	uint16_t reserved;
+} cacheSymbol;
+
+typedef struct {
+	uint32_t length;	// bytes in the name bytes, names follow each other
+	uint8_t kindBefore, kindAfter;
+	uint16_t reserved;
+	cacheSymbol before, after;
+} cacheName;
+
+typedef struct {
+	uint32_t name;
+	uint32_t line;
+	uint16_t offset;
+	uint8_t action;
+	uint8_t size;
+	uint8_t type;
+	uint8_t reserved[3];
+} cacheBackpatch;
+
+typedef struct {
+	uint32_t value;
+	uint16_t offset;
+	uint8_t op;
+	uint8_t type;
+} cacheRelocation;
+
+typedef struct {
+	uint32_t offset;
+	uint32_t count;
+	uint8_t value;
+	uint8_t reserved[3];
+} cacheFill;
+
+static_assert(sizeof(cacheHeader) == 72 + 4 * numberOfRegex, "cache header layout");
+static_assert(sizeof(cacheSymbol) == 16, "cache symbol layout");
+static_assert(sizeof(cacheName) == 40, "cache name layout");
+static_assert(sizeof(cacheBackpatch) == 16, "cache backpatch layout");
+static_assert(sizeof(cacheRelocation) == 8, "cache relocation layout");
+static_assert(sizeof(cacheFill) == 12, "cache fill layout");
+
+cacheSymbol encodeSymbol(const symbolTableEntry& entry) {
+	return { entry.number, entry.sectionNumber, entry.offset, entry.size, entry.type, entry.symbolType, 0 };
+}
+
+symbolTableEntry decodeSymbol(const cacheSymbol& symbol) {
+	return { symbol.number, symbol.sectionNumber, symbol.offset, symbol.type, symbol.size, symbol.symbolType };
+}
+
+template<typename T>
+void put(std::string& out, const T& record) {
+	out.append(reinterpret_cast<const char*>(&record), sizeof(T));
+}
+
+// reads records in order, fails once instead of checking every read
+class Reader {
+public:
+	Reader(const uint8_t *data, size_t size) : data(data), size(size) {
+	}
+
+	template<typename T>
+	bool get(T& record) {
+		return bytes(&record, sizeof(T));
+	}
+
+	bool bytes(void *to, size_t count) {
+		if (count > size - position) {
+			return false;
+		}
+		memcpy(to, data + position, count);
+		position += count;
+		return true;
+	}
+
+	std::string_view view(size_t count) {
+		if (count > size - position) {
+			return std::string_view();
+		}
+		position += count;
+		return std::string_view(reinterpret_cast<const char*>(data + position - count), count);
+	}
+
+	bool atEnd() const {
+		return position == size;
+	}
+private:
+	const uint8_t *data;
+	size_t size;
+	size_t position = 0;
+};
+
+}
+
+bool SectionCache::open(const std::string& directory) {
+	if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+		return false;
+	}
+	struct stat info;
+	if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+		return false;
+	}
+	this->directory = directory;
+	return true;
+}
+
+bool SectionCache::isOpen() const {
+	return directory != "";
+}
+
+// FNV-1a
+uint64_t SectionCache::hash(std::string_view text) {
+	uint64_t value = 14695981039346656037ull;
+	for (auto ch : text) {
+		value = (value ^ (uint8_t)ch) * 1099511628211ull;
+	}
+	return value;
+}
+
+std::string SectionCache::path(std::string_view text) const {
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.sec", (unsigned long long)hash(text));
+	return directory + "/" + name;
+}
+
+bool SectionCache::load(std::string_view text, cachedSection& entry) const {
+	MappedFile file;
+	if (!file.open(path(text))) {
+		return false;
+	}
+	Reader in(file.data(), file.size());
+	cacheHeader header;
+	if (!in.get(header) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION
+			|| header.textSize != text.size() || in.view(text.size()) != text) {
+		return false;
+	}
+	entry.text = std::string(text);
+	entry.sectionNumber = header.sectionNumber;
+	entry.flags = header.flags;
+	entry.symbolsBefore = header.symbolsBefore;
+	entry.symbolsAfter = header.symbolsAfter;
+	entry.lines = header.lines;
+	memcpy(entry.lineTypes, header.lineTypes, sizeof(entry.lineTypes));
+	entry.size = header.size;
+	entry.macros = header.macros;
+	entry.expansionsBefore = header.expansionsBefore;
+	entry.expansionsAfter = header.expansionsAfter;
+
+	auto nameBytes = in.view(header.nameBytes);
+	if (nameBytes.size() != header.nameBytes) {
+		return false;
+	}
+	entry.names.clear();
+	size_t nameOffset = 0;
+	for (uint32_t i = 0; i < header.nameCount; i++) {
+		cacheName name;
+		if (!in.get(name) || name.length > nameBytes.size() - nameOffset) {
+			return false;
+		}
+		entry.names.push_back( { std::string(nameBytes.substr(nameOffset, name.length)), name.kindBefore, name.kindAfter,
+				decodeSymbol(name.before), decodeSymbol(name.after) });
+		nameOffset += name.length;
+	}
+
+	entry.backpatch.clear();
+	for (uint32_t i = 0; i < header.backpatchCount; i++) {
+		cacheBackpatch backpatch;
+		if (!in.get(backpatch) || backpatch.name >= header.nameCount || backpatch.type > LITERAL) {
+			return false;
+		}
+		entry.backpatch.push_back( { backpatch.name, backpatch.line, backpatch.offset, (char)backpatch.action, backpatch.size,
+				backpatch.type });
+	}
+
+	entry.relocations.clear();
+	for (uint32_t i = 0; i < header.relocationCount; i++) {
+		cacheRelocation relocation;
+		if (!in.get(relocation) || relocation.type > LITERAL) {
+			return false;
+		}
+		entry.relocations.push_back( { relocation.offset, relocation.type, (char)relocation.op, relocation.value });
+	}
+
+	entry.fills.clear();
+	for (uint32_t i = 0; i < header.fillCount; i++) {
+		cacheFill fill;
+		if (!in.get(fill)) {
+			return false;
+		}
+		entry.fills.push_back( { fill.offset, fill.count, fill.value });
+	}
+
+	entry.bytes.resize(header.dataSize);
+	return in.bytes(entry.bytes.data(), entry.bytes.size()) && in.atEnd();
+}
+
+void SectionCache::store(const cachedSection& entry) const {
+	cacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.flags = entry.flags;
+	header.sectionNumber = entry.sectionNumber;
+	header.symbolsBefore = entry.symbolsBefore;
+	header.symbolsAfter = entry.symbolsAfter;
+	header.lines = entry.lines;
+	memcpy(header.lineTypes, entry.lineTypes, sizeof(header.lineTypes));
+	header.size = entry.size;
+	header.textSize = entry.text.size();
+	header.nameCount = entry.names.size();
+	header.backpatchCount = entry.backpatch.size();
+	header.relocationCount = entry.relocations.size();
+	header.fillCount = entry.fills.size();
+	header.dataSize = entry.bytes.size();
+	header.macros = entry.macros;
+	header.expansionsBefore = entry.expansionsBefore;
+	header.expansionsAfter = entry.expansionsAfter;
+	for (auto& name : entry.names) {
+		header.nameBytes += name.name.size();
+	}
+
+	std::string out;
+	put(out, header);
+	out += entry.text;
+	for (auto& name : entry.names) {
+		out += name.name;
+	}
+	for (auto& name : entry.names) {
+		put(out, cacheName { (uint32_t)name.name.size(), name.kindBefore, name.kindAfter, 0, encodeSymbol(name.before),
+				encodeSymbol(name.after) });
+	}
+	for (auto& backpatch : entry.backpatch) {
+		put(out, cacheBackpatch { backpatch.name, backpatch.line, backpatch.offset, (uint8_t)backpatch.action, backpatch.size,
+				backpatch.relocationType, { } });
+	}
+	for (auto& relocation : entry.relocations) {
+		put(out, cacheRelocation { relocation.value, relocation.offset, (uint8_t)relocation.op, relocation.type });
+	}
+	for (auto& fill : entry.fills) {
+		put(out, cacheFill { fill.offset, fill.count, fill.value, { } });
+	}
+	out.append(reinterpret_cast<const char*>(entry.bytes.data()), entry.bytes.size());
+
+	// written next to the target and renamed over it, unique per process and store
+	static std::atomic<uint32_t> stores(0);
+	auto target = path(entry.text);
+	auto temporary = target + "." + std::to_string(getpid()) + "." + std::to_string(stores++) + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::out | std::ios::binary);
+		file.write(out.data(), out.size());
+		if (!file.good()) {
+			file.close();
+			remove(temporary.c_str());
+			return;
+		}
+	}
+	if (rename(temporary.c_str(), target.c_str()) != 0) {
+		remove(temporary.c_str());
+	}
+}
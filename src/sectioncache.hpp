@@ -0,0 +1,73 @@
+#ifndef _sectioncache_hpp_
+#define _sectioncache_hpp_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "auxiliary.hpp"
+
+/*
+ * Identifier a section body looked up, as it was before the body and after it.
+ * Encoding a body depends on nothing else but the section it is in, the symbol counter and the macros,
+ * so equal text and equal states before give equal bytes, relocations and states after.
+ */
+typedef struct {
+	std::string name;
+	uint8_t kindBefore, kindAfter;	// ID_NONE, ID_SYMBOL, ID_LITERAL
+	symbolTableEntry before, after;	// ID_SYMBOL only
+} cachedName;
+
+// forward reference made by the body, the symbol is an index into names
+typedef struct {
+	uint32_t name;
+	uint32_t line;	// from the section line
+	uint16_t offset;
+	char action;
+	uint8_t size;
+	uint8_t relocationType;
+} cachedBackpatch;
+
+// everything the lines between two section lines added
+typedef struct {
+	std::string text;
+	uint32_t sectionNumber;
+	uint16_t flags;
+	uint32_t symbolsBefore, symbolsAfter;	// symbol counter
+	uint32_t lines;
+	uint32_t lineTypes[numberOfRegex];	// lines encoded, by type, expansions included, for the stats of a hit
+	uint16_t size;
+	uint64_t macros;	// hash of the macro definitions the body was encoded with
+	uint32_t expansionsBefore, expansionsAfter;	// expansion counter, labels in expansions are numbered by it
+	std::vector<cachedName> names;
+	std::vector<cachedBackpatch> backpatch;
+	std::vector<relocationEntry> relocations;
+	std::vector<uint8_t> bytes;
+	std::vector<fillRun> fills;
+} cachedSection;
+
+/*
+ * Directory of encoded section bodies, one file per body named after the hash of its text.
+ * A file holds the text itself, a hash collision is a miss. Files are replaced by rename,
+ * processes sharing a directory see either the old or the new body.
+ */
+class SectionCache {
+public:
+	// creates the directory if needed
+	bool open(const std::string& directory);
+	bool isOpen() const;
+
+	// false if there is no body with this text or the file is damaged
+	bool load(std::string_view text, cachedSection& entry) const;
+	// best effort, a failed write only costs the next run a miss
+	void store(const cachedSection& entry) const;
+
+	static uint64_t hash(std::string_view text);
+private:
+	std::string path(std::string_view text) const;
+
+	std::string directory;
+};
+
+#endif
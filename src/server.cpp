@@ -0,0 +1,249 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "assembler.hpp"
+#include "mappedfile.hpp"
+#include "objformat.hpp"
+#include "server.hpp"
+
+Server::Server(std::string socketPath, unsigned workers) : socketPath(socketPath), workers(workers) {
+	if (this->workers == 0) {
+		this->workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+int Server::run() {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path too long " << socketPath << std::endl;
+		return ERR_ARGUMENT;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	// a socket file left by a server that didn't shut down is replaced
+	unlink(socketPath.c_str());
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		std::cerr << "Unable to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+		if (listener >= 0) {
+			close(listener);
+		}
+		return ERR_FOPEN;
+	}
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < workers; i++) {
+		pool.emplace_back(&Server::worker, this);
+	}
+	while (true) {
+		auto fd = accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping) {
+			close(fd);
+			break;
+		}
+		queue.push_back( { fd, std::chrono::steady_clock::now(), (uint32_t)queue.size() });
+		maxQueue = std::max<uint32_t>(maxQueue, queue.size());
+		ready.notify_one();
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		ready.notify_all();
+	}
+	for (auto& thread : pool) {
+		thread.join();
+	}
+	close(listener);
+	unlink(socketPath.c_str());
+	return ERR_OK;
+}
+
+// queued connections are still served
+void Server::stop() {
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = true;
+	shutdown(listener, SHUT_RDWR);
+	ready.notify_all();
+}
+
+void Server::worker() {
+	Assembler assembler;
+	while (true) {
+		pendingConnection connection;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [this] {
+				return stopping || !queue.empty();
+			});
+			if (queue.empty()) {
+				return;
+			}
+			connection = queue.front();
+			queue.pop_front();
+		}
+		// whatever a connection throws drops that connection only
+		try {
+			serve(assembler, connection);
+		} catch (const std::exception& error) {
+			std::cerr << "Connection dropped: " << error.what() << std::endl;
+		}
+		close(connection.fd);
+	}
+}
+
+void Server::serve(Assembler& assembler, const pendingConnection& connection) {
+	protocolMessage request, response;
+	if (!readMessage(connection.fd, request)) {
+		return;
+	}
+	auto command = request.get("command");
+	if (command == "assemble") {
+		assemble(assembler, request, response);
+	} else if (command == "stats") {
+		statistics(response);
+	} else if (command == "shutdown") {
+		response.set("status", std::to_string(ERR_OK));
+		stop();
+	} else {
+		response.body = "Unknown command " + command + "\n";
+		response.set("status", std::to_string(ERR_ARGUMENT));
+		response.set("messages", std::to_string(response.body.size()));
+	}
+
+	auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()
+			- connection.accepted).count();
+	response.set("latency", std::to_string(latency));
+	response.set("queue", std::to_string(connection.queue));
+	writeMessage(connection.fd, response);
+
+	if (command == "assemble") {
+		std::lock_guard<std::mutex> guard(lock);
+		requests++;
+		failed += response.get("status") != "0";
+		totalLatency += latency;
+		maxLatency = std::max<uint64_t>(maxLatency, latency);
+	}
+}
+
+void Server::assemble(Assembler& assembler, const protocolMessage& request, protocolMessage& response) {
+	auto source = request.get("source");
+	auto output = request.get("output");
+	auto format = request.get("format");
+	auto maxErrors = request.get("max-errors");
+	auto cache = request.get("cache");
+	auto include = request.get("include");
+	auto optimize = request.get("optimize");
+	auto fail = [&](int code, std::string message) {
+		response.set("status", std::to_string(code));
+		response.body = (source == "" ? "-" : source) + ": error: " + message + "\n";
+		response.set("messages", std::to_string(response.body.size()));
+	};
+
+	// an exception the assembler lets through answers this request only, the worker keeps serving
+	try {
+		if ((format != "" && format != "text" && format != "bin") || maxErrors.find_first_not_of("0123456789") != std::string::npos
+				|| maxErrors.size() > 9 || (optimize != "" && optimize != "size")) {
+			fail(ERR_ARGUMENT, "Invalid request");
+			return;
+		}
+		assembler.setMaxErrors(maxErrors == "" ? 20 : std::stoul(maxErrors));
+		assembler.setOptimizeSize(optimize == "size");
+		assembler.getCache() = SectionCache();
+		if (cache != "" && !assembler.getCache().open(cache)) {
+			fail(ERR_FOPEN, "Error while trying to open cache directory");
+			return;
+		}
+
+		// include directories separated by ':'
+		std::vector<std::string> includePaths;
+		for (size_t start = 0; start < include.size();) {
+			auto end = std::min(include.find(':', start), include.size());
+			if (end != start) {
+				includePaths.push_back(include.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		assembler.setIncludePaths(includePaths);
+		assembler.setSourcePath(source);
+
+		MappedFile file;
+		std::string_view text = request.body;
+		if (source != "") {
+			if (!file.open(source)) {
+				fail(ERR_FOPEN, "Error while trying to open src file");
+				return;
+			}
+			text = file.text();
+		}
+		auto result = assembler.assemble(text);
+		if (!result.success) {
+			std::string messages;
+			for (auto& error : result.diagnostics) {
+				messages += formatDiagnostic(source == "" ? "-" : source, error) + "\n";
+			}
+			if (result.truncated) {
+				messages += (source == "" ? "-" : source) + ": stopped after " + std::to_string(result.diagnostics.size())
+						+ " errors, see --max-errors\n";
+			}
+			response.set("status", std::to_string(result.diagnostics.front().code));
+			response.set("messages", std::to_string(messages.size()));
+			response.body = messages;
+			return;
+		}
+
+		std::ostringstream object;
+		if (format == "bin") {
+			ObjectFormat::writeBinary(result, object);
+		} else {
+			ObjectFormat::writeText(result, object);
+		}
+		if (output != "") {
+			std::ofstream out(output, std::ios::out | std::ios::binary);
+			auto bytes = object.str();
+			out.write(bytes.data(), bytes.size());
+			if (!out.good()) {
+				fail(ERR_FOPEN, "Error while trying to create obj file");
+				return;
+			}
+			response.set("status", std::to_string(ERR_OK));
+			response.set("messages", "0");
+			return;
+		}
+		response.set("status", std::to_string(ERR_OK));
+		response.set("messages", "0");
+		response.body = object.str();
+	} catch (const std::exception& error) {
+		fail(ERR_ARGUMENT, error.what());
+	}
+}
+
+void Server::statistics(protocolMessage& response) {
+	std::lock_guard<std::mutex> guard(lock);
+	response.set("status", std::to_string(ERR_OK));
+	response.set("workers", std::to_string(workers));
+	response.set("requests", std::to_string(requests));
+	response.set("failed", std::to_string(failed));
+	response.set("queued", std::to_string(queue.size()));
+	response.set("max-queue", std::to_string(maxQueue));
+	response.set("mean-latency", std::to_string(requests ? totalLatency / requests : 0));
+	response.set("max-latency", std::to_string(maxLatency));
+}
@@ -0,0 +1,53 @@
+#ifndef _server_hpp_
+#define _server_hpp_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "protocol.hpp"
+
+class Assembler;
+
+typedef struct {
+	int fd;
+	std::chrono::steady_clock::time_point accepted;
+	uint32_t queue;	// connections waiting when it was accepted
+} pendingConnection;
+
+/*
+ * Assembles requests from a Unix domain socket (src/protocol.hpp) on a pool of worker threads.
+ * Every worker keeps one Assembler for all its requests, tables and code chunks stay allocated.
+ */
+class Server {
+public:
+	Server(std::string socketPath, unsigned workers);
+
+	// serves until a shutdown request, returns an exit code
+	int run();
+private:
+	void worker();
+	void serve(Assembler& assembler, const pendingConnection& connection);
+	void assemble(Assembler& assembler, const protocolMessage& request, protocolMessage& response);
+	void statistics(protocolMessage& response);
+	void stop();
+
+	std::string socketPath;
+	unsigned workers;
+	int listener = -1;
+
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<pendingConnection> queue;
+	bool stopping = false;
+
+	// guarded by lock
+	uint64_t requests = 0, failed = 0;
+	uint64_t totalLatency = 0, maxLatency = 0;	// microseconds
+	uint32_t maxQueue = 0;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include "spillfile.hpp"
+
+namespace {
+
+bool writeAll(int fd, const uint8_t *bytes, size_t count, uint64_t offset) {
+	while (count) {
+		auto written = pwrite(fd, bytes, count, offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		bytes += written;
+		count -= written;
+		offset += written;
+	}
+	return true;
+}
+
+bool readAll(int fd, uint8_t *bytes, size_t count, uint64_t offset) {
+	while (count) {
+		auto read = pread(fd, bytes, count, offset);
+		if (read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (read == 0) {
+			return false;
+		}
+		bytes += read;
+		count -= read;
+		offset += read;
+	}
+	return true;
+}
+
+}
+
+SpillFile::~SpillFile() {
+	close();
+}
+
+bool SpillFile::open(const std::string& directory) {
+	close();
+	std::string path = (directory.empty() ? std::string(".") : directory) + "/asm-spill-XXXXXX";
+	fd = mkstemp(&path[0]);
+	if (fd < 0) {
+		return false;
+	}
+	unlink(path.c_str());
+	end = 0;
+	return true;
+}
+
+void SpillFile::close() {
+	if (fd >= 0) {
+		::close(fd);
+	}
+	fd = -1;
+	end = 0;
+	patches.clear();
+}
+
+bool SpillFile::isOpen() const {
+	return fd >= 0;
+}
+
+bool SpillFile::clear() {
+	end = 0;
+	patches.clear();
+	return ftruncate(fd, 0) == 0;
+}
+
+bool SpillFile::append(const std::vector<uint8_t>& bytes, uint64_t& offset) {
+	offset = end;
+	if (!writeAll(fd, bytes.data(), bytes.size(), end)) {
+		return false;
+	}
+	end += bytes.size();
+	return true;
+}
+
+void SpillFile::patch(uint64_t offset, int32_t value, uint8_t size) {
+	patches.push_back( { offset, value, size });
+}
+
+bool SpillFile::applyPatches() {
+	std::sort(patches.begin(), patches.end(), [](const spillPatch& a, const spillPatch& b) {
+		return a.offset < b.offset;
+	});
+	size_t next = 0;
+	while (next < patches.size()) {
+		// every patch that ends inside the block starting at the first one
+		auto start = patches[next].offset;
+		auto last = next;
+		uint64_t through = start;
+		while (last < patches.size() && patches[last].offset + patches[last].size <= start + BLOCK_SIZE) {
+			through = std::max(through, patches[last].offset + patches[last].size);
+			last++;
+		}
+		block.resize(through - start);
+		if (!readAll(fd, block.data(), block.size(), start)) {
+			return false;
+		}
+		for (; next < last; next++) {
+			auto& patch = patches[next];
+			auto byte = &block[patch.offset - start];
+			if (patch.size == 1) {
+				byte[0] += patch.value;
+			} else {
+				uint16_t word = (byte[0] | (byte[1] << 8)) + patch.value;
+				byte[0] = word;
+				byte[1] = word >> 8;
+			}
+		}
+		if (!writeAll(fd, block.data(), block.size(), start)) {
+			return false;
+		}
+	}
+	patches.clear();
+	return true;
+}
+
+bool SpillFile::read(uint64_t offset, uint8_t *bytes, size_t count) const {
+	return readAll(fd, bytes, count, offset);
+}
+
+uint64_t SpillFile::size() const {
+	return end;
+}
@@ -0,0 +1,52 @@
+#ifndef _spillfile_hpp_
+#define _spillfile_hpp_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// value added to size bytes, little endian, at offset in the spill file
+typedef struct {
+	uint64_t offset;
+	int32_t value;
+	uint8_t size;
+} spillPatch;
+
+/*
+ * Unlinked temporary file the bytes of finished sections are moved to (asm --spill dir).
+ * Patches to moved bytes are collected and applied after the pass in file order,
+ * every block they touch is read and written back once.
+ */
+class SpillFile {
+public:
+	SpillFile() = default;
+	~SpillFile();
+
+	SpillFile(const SpillFile&) = delete;
+	SpillFile& operator=(const SpillFile&) = delete;
+
+	// the file is gone from the directory as soon as it is created
+	bool open(const std::string& directory);
+	void close();
+	bool isOpen() const;
+	// drops the bytes and patches of the last assembly
+	bool clear();
+
+	// false if the write failed, offset - where the bytes start in the file
+	bool append(const std::vector<uint8_t>& bytes, uint64_t& offset);
+	void patch(uint64_t offset, int32_t value, uint8_t size);
+	bool applyPatches();
+	bool read(uint64_t offset, uint8_t *bytes, size_t count) const;
+
+	uint64_t size() const;
+private:
+	static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+	int fd = -1;
+	uint64_t end = 0;
+	std::vector<spillPatch> patches;
+	std::vector<uint8_t> block;
+};
+
+#endif
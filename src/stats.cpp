@@ -0,0 +1,188 @@
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "stats.hpp"
+
+namespace {
+
+const char *phaseNames[PHASE_COUNT] = { "parse", "literals", "backpatch", "result", "output" };
+const char *hardwareNames[HW_COUNTERS] = { "cycles", "instructions", "cacheMisses" };
+const char *lineTypeNames[numberOfRegex] = { "comment", "label", "section", "equ", "global", "extern", "byte",
+		"word", "skip", "instrNoOperand", "instrOneOperand", "instrTwoOperand", "align", "fill", "zero", "macro", "endm", "rept", "endr", "include" };
+
+#ifdef __linux__
+int openCounter(uint64_t config, int group) {
+	perf_event_attr attr { };
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+void writeCounters(std::ostream& out, const char *names[], const uint64_t values[], uint8_t count) {
+	out << '{';
+	for (uint8_t i = 0; i < count; i++) {
+		out << (i ? ", \"" : "\"") << names[i] << "\": " << values[i];
+	}
+	out << '}';
+}
+
+double perSecond(uint64_t count, double seconds) {
+	return seconds > 0 ? count / seconds : 0;
+}
+
+}
+
+Stats::~Stats() {
+	closeHardware();
+}
+
+void Stats::closeHardware() {
+#ifdef __linux__
+	for (auto& fd : perfMembers) {
+		if (fd >= 0) {
+			::close(fd);
+		}
+		fd = -1;
+	}
+	if (perf >= 0) {
+		::close(perf);
+	}
+	perf = -1;
+#endif
+}
+
+void Stats::enable(bool hardware) {
+	on = true;
+#ifdef __linux__
+	if (!hardware || perf >= 0) {
+		return;
+	}
+	perf = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (perf < 0) {
+		return;
+	}
+	perfMembers[0] = openCounter(PERF_COUNT_HW_INSTRUCTIONS, perf);
+	perfMembers[1] = openCounter(PERF_COUNT_HW_CACHE_MISSES, perf);
+	if (perfMembers[0] < 0 || perfMembers[1] < 0) {
+		closeHardware();
+		return;
+	}
+	ioctl(perf, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	(void)hardware;
+#endif
+}
+
+void Stats::clear() {
+	clearCounters();
+	for (auto& phase : phases) {
+		phase = phaseStats { };
+	}
+}
+
+void Stats::clearCounters() {
+	counters = statCounters { };
+}
+
+void Stats::readHardware(uint64_t values[HW_COUNTERS]) const {
+#ifdef __linux__
+	uint64_t group[1 + HW_COUNTERS] = { };
+	if (perf >= 0 && read(perf, group, sizeof(group)) == sizeof(group)) {
+		for (uint8_t i = 0; i < HW_COUNTERS; i++) {
+			values[i] = group[1 + i];
+		}
+		return;
+	}
+#endif
+	for (uint8_t i = 0; i < HW_COUNTERS; i++) {
+		values[i] = 0;
+	}
+}
+
+void Stats::begin(StatPhase) {
+	if (!on) {
+		return;
+	}
+	readHardware(startHardware);
+	started = std::chrono::steady_clock::now();
+}
+
+void Stats::end(StatPhase phase) {
+	if (!on) {
+		return;
+	}
+	auto elapsed = std::chrono::steady_clock::now() - started;
+	phases[phase].seconds += std::chrono::duration<double>(elapsed).count();
+	uint64_t values[HW_COUNTERS];
+	readHardware(values);
+	for (uint8_t i = 0; i < HW_COUNTERS; i++) {
+		phases[phase].hardware[i] += values[i] - startHardware[i];
+	}
+}
+
+void Stats::writeJson(std::ostream& out, const std::string& source, bool success) const {
+	auto& c = counters;
+	double total = 0;
+	for (auto& phase : phases) {
+		total += phase.seconds;
+	}
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"source\": \"";
+	for (auto ch : source) {
+		if (ch == '"' || ch == '\\') {
+			out << '\\';
+		}
+		out << ch;
+	}
+	out << "\",\n  \"success\": " << (success ? "true" : "false");
+	out << ",\n  \"sourceBytes\": " << c.sourceBytes << ",\n  \"lines\": " << c.lines;
+	out << ",\n  \"totalMs\": " << total * 1e3 << ",\n  \"linesPerSec\": " << perSecond(c.lines, total);
+	out << ",\n  \"hardware\": " << (hardwareEnabled() ? "true" : "false");
+
+	out << ",\n  \"phases\": {";
+	for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+		out << (i ? ",\n    \"" : "\n    \"") << phaseNames[i] << "\": {\"ms\": " << phases[i].seconds * 1e3
+				<< ", \"linesPerSec\": " << perSecond(c.lines, phases[i].seconds);
+		if (hardwareEnabled()) {
+			out << ", \"hardware\": ";
+			writeCounters(out, hardwareNames, phases[i].hardware, HW_COUNTERS);
+		}
+		out << '}';
+	}
+	out << "\n  },\n  \"lineTypes\": ";
+	writeCounters(out, lineTypeNames, c.lineTypes, numberOfRegex);
+	out << ",\n  \"operandMatches\": ";
+	writeCounters(out, lineTypeNames, c.operandMatches, numberOfRegex);
+
+	out << ",\n  \"symbols\": {\"lookups\": " << c.lookups << ", \"probes\": " << c.probes << ", \"names\": "
+			<< c.names << ", \"slots\": " << c.slots << ", \"literals\": " << c.literals << ", \"sections\": "
+			<< c.sections << '}';
+	out << ",\n  \"sectionCache\": {\"hits\": " << c.cachedSections << ", \"misses\": " << c.encodedSections << '}';
+	out << ",\n  \"macros\": {\"definitions\": " << c.macroDefinitions << ", \"expansions\": " << c.macroExpansions
+			<< ", \"repetitions\": " << c.reptExpansions << ", \"expandedLines\": " << c.expandedLines
+			<< ", \"relexedLines\": " << c.relexedLines << '}';
+	out << ",\n  \"includes\": {\"files\": " << c.includes << ", \"cached\": " << c.cachedIncludes << ", \"lines\": "
+			<< c.includedLines << '}';
+	out << ",\n  \"spill\": {\"sections\": " << c.spilledSections << ", \"bytes\": " << c.spilledBytes
+			<< ", \"patches\": " << c.spillPatches << '}';
+	out << ",\n  \"relaxation\": {\"passes\": " << c.relaxPasses << ", \"operands\": " << c.relaxedOperands
+			<< ", \"bytes\": " << c.relaxedBytes << '}';
+	out << ",\n  \"forwardReferences\": " << c.forwardReferences << ",\n  \"definitionBackpatches\": "
+			<< c.definitionBackpatches << ",\n  \"peakBackpatches\": " << c.peakBackpatches << ",\n  \"literalBackpatches\": "
+			<< c.literalBackpatches << ",\n  \"relocations\": " << c.relocations << ",\n  \"codeBytes\": "
+			<< c.codeBytes << ",\n  \"objectBytes\": " << c.objectBytes << "\n}" << std::endl;
+}
@@ -0,0 +1,89 @@
+#ifndef _stats_hpp_
+#define _stats_hpp_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "auxiliary.hpp"
+
+enum StatPhase : uint8_t {
+	PHASE_PARSE, PHASE_LITERALS, PHASE_BACKPATCH, PHASE_RESULT, PHASE_OUTPUT, PHASE_COUNT
+};
+
+// cycles, instructions, cache misses
+constexpr uint8_t HW_COUNTERS = 3;
+
+typedef struct {
+	double seconds;
+	uint64_t hardware[HW_COUNTERS];
+} phaseStats;
+
+typedef struct {
+	uint64_t sourceBytes;
+	uint64_t lines;
+	uint64_t lineTypes[numberOfRegex];
+	uint64_t operandMatches[numberOfRegex];	// operand classifier calls, by line type
+	uint64_t lookups, probes;	// identifier table
+	uint64_t names, slots, literals, sections;
+	uint64_t forwardReferences;	// backpatch entries for labels not yet defined
+	uint64_t definitionBackpatches;	// of them applied when the label was defined, the rest after the pass
+	uint64_t peakBackpatches;	// most entries waiting at once
+	uint64_t literalBackpatches;
+	uint64_t cachedSections, encodedSections;	// section bodies taken from and missing in --cache
+	uint64_t macroDefinitions, macroExpansions, reptExpansions;
+	uint64_t expandedLines, relexedLines;	// lines out of macro bodies, relexed - went through the lexer again
+	uint64_t includes, cachedIncludes, includedLines;	// cached - lexed by an earlier assembly in the process
+	uint64_t spilledSections, spilledBytes, spillPatches;	// patches - to bytes already in the spill file
+	uint64_t relaxPasses, relaxedOperands, relaxedBytes;	// -Os, operands encoded as register indirect, bytes saved
+	uint64_t relocations;
+	uint64_t codeBytes;
+	uint64_t objectBytes;
+} statCounters;
+
+/*
+ * Per-phase wall time and assembly counters, reported as one JSON object.
+ * Hardware counters come from perf_event_open and are left out where it isn't permitted.
+ */
+class Stats {
+public:
+	Stats() = default;
+	~Stats();
+
+	Stats(const Stats&) = delete;
+	Stats& operator=(const Stats&) = delete;
+
+	void enable(bool hardware);
+	bool enabled() const {
+		return on;
+	}
+	bool hardwareEnabled() const {
+		return perf >= 0;
+	}
+
+	// zeroes counters and times, stays enabled
+	void clear();
+	// zeroes the counters only, the times of the phases add up over several passes
+	void clearCounters();
+
+	void begin(StatPhase phase);
+	void end(StatPhase phase);
+
+	void writeJson(std::ostream& out, const std::string& source, bool success) const;
+
+	statCounters counters { };
+private:
+	void readHardware(uint64_t values[HW_COUNTERS]) const;
+	void closeHardware();
+
+	bool on = false;
+	int perf = -1;	// group leader, -1 - no hardware counters
+	int perfMembers[HW_COUNTERS - 1] = { -1, -1 };
+
+	phaseStats phases[PHASE_COUNT] { };
+	std::chrono::steady_clock::time_point started;
+	uint64_t startHardware[HW_COUNTERS] { };
+};
+
+#endif
@@ -0,0 +1,15 @@
+.global _start
+.extern ext
+
+.equ later, base*2 + (1 << 4)
+.equ base, (0x10 | 0b11) & 0xff
+.equ neg, -(base - 3) / 2
+.equ reloc, here - there + later
+.equ shifted, (later >> 1) - ext
+
+.text
+_start:
+here: .word later,base,neg,reloc
+there: .word ext,shifted
+	mov $later, %r1
+.end
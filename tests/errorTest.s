@@ -0,0 +1,19 @@
+.global start
+.equ deep, ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++1
+.data
+values: .word 1,2
+.word 99999999999
+.word 3
+.byte 256
+.byte 4
+.skip 99999999999
+.word missing
+.text
+start: mov $1, %r1
+mov $99999999999, %r2
+bad line here
+add %r1, %r2
+mov 99999999999(%r3), %r4
+jmp start
+halt
+.end
@@ -0,0 +1,26 @@
+.global start
+.extern print
+
+.text
+start:
+    mov $buffer, %r0
+    call print
+.align 4
+table:
+    .word start,buffer
+.fill 3,2,0x1234
+.align 8,0
+    jmp *start(%pc)
+    halt
+
+.data
+header: .byte 1,2
+.zero 6
+message: .word message
+.fill 4,1,0x7f
+
+.bss
+buffer: .skip 0x100
+.align 0x10
+counters: .zero 32
+.end
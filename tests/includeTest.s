@@ -0,0 +1,9 @@
+.global _start
+.include "includeTest.inc"
+
+.text
+_start:
+	clear %r0
+	mov $size, %r1
+	call exit
+.end
@@ -0,0 +1,45 @@
+.global _start
+.extern exit
+
+.macro push2 a,b
+	push \a
+	push \b
+.endm
+
+.macro countdown reg,n
+	mov $\n, \reg
+loop:	sub $1, \reg   # labels are per expansion
+	test \reg, \reg
+	jne loop
+.endm
+
+.macro store value
+	.word \value,-\value
+.endm
+
+.macro clear r
+	xor \r, \r
+.endm
+
+.macro twice r
+	clear \r
+	clear \r
+.endm
+
+.text
+_start:
+	push2 %r1,%r2
+	countdown %r3, 5
+again:	countdown %r4, 0x10
+	twice %r0
+	call exit
+.data
+	store 7
+table:	.rept 3
+	.byte 1,2
+	.word table
+.endr
+	.rept 2
+first:	.byte 0x5
+.endr
+.end
@@ -0,0 +1,13 @@
+.global start
+.data
+words: .word 1,99999999999,2
+.word 65536
+.word 0x10000
+bytes: .byte 99999999999
+.byte 256,3
+.byte 0x100
+.text
+start: mov $99999999999, %r1
+movb $256, %r1l
+halt
+.end
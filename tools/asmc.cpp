@@ -0,0 +1,144 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+#include "../src/auxiliary.hpp"
+#include "../src/protocol.hpp"
+
+/*
+ * Client of asm --server, takes the arguments of asm.
+ * usage: asmc src.s -o obj.o [-f text|bin] [--max-errors n] [--cache dir] [-I dir]... [-Os] [--timing]
+ *        asmc --stats | --shutdown
+ * The socket is $ASM_SOCKET, /tmp/asm.sock without it. src.s - sends stdin, -o - prints the object.
+ */
+
+static void printUsage() {
+	std::cerr << "usage: asmc src.s -o obj.o [-f text|bin] [--max-errors n] [--cache dir] [-I dir]... [-Os] [--timing]" << std::endl;
+	std::cerr << "       asmc --stats | --shutdown" << std::endl;
+}
+
+// the server has its own working directory
+static std::string absolute(const std::string& path) {
+	if (path == "" || path[0] == '/') {
+		return path;
+	}
+	char directory[4096];
+	if (getcwd(directory, sizeof(directory)) == nullptr) {
+		return path;
+	}
+	return std::string(directory) + "/" + path;
+}
+
+static int connectServer() {
+	auto path = getenv("ASM_SOCKET");
+	std::string socketPath = path ? path : "/tmp/asm.sock";
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+	auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char *argv[]) {
+	protocolMessage request, response;
+	std::string source, object, format, maxErrors, cache, include;
+	auto timing = false, optimizeSize = false;
+	for (auto i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if ((arg == "-o" || arg == "-f" || arg == "--max-errors" || arg == "--cache") && i + 1 < argc) {
+			(arg == "-o" ? object : arg == "-f" ? format : arg == "--cache" ? cache : maxErrors) = argv[++i];
+		} else if (arg == "-I" && i + 1 < argc) {
+			include += (include == "" ? "" : ":") + absolute(argv[++i]);
+		} else if (arg == "-Os") {
+			optimizeSize = true;
+		} else if (arg == "--timing") {
+			timing = true;
+		} else if (arg == "--stats" || arg == "--shutdown") {
+			request.set("command", arg.substr(2));
+		} else if (arg[0] != '-' || arg == "-") {
+			source = arg;
+		} else {
+			printUsage();
+			return ERR_ARGUMENT;
+		}
+	}
+	if (request.fields.empty()) {
+		if (source == "" || object == "") {
+			printUsage();
+			return ERR_ARGUMENT;
+		}
+		request.set("command", "assemble");
+		if (source == "-") {
+			request.body.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+		} else {
+			request.set("source", absolute(source));
+		}
+		if (object != "-") {
+			request.set("output", absolute(object));
+		}
+		if (format != "") {
+			request.set("format", format);
+		}
+		if (maxErrors != "") {
+			request.set("max-errors", maxErrors);
+		}
+		if (cache != "") {
+			request.set("cache", absolute(cache));
+		}
+		if (include != "") {
+			request.set("include", include);
+		}
+		if (optimizeSize) {
+			request.set("optimize", "size");
+		}
+	}
+
+	auto fd = connectServer();
+	if (fd < 0) {
+		std::cerr << "Unable to connect to the assembler server, start it with asm --server socket" << std::endl;
+		return ERR_FOPEN;
+	}
+	if (!writeMessage(fd, request) || !readMessage(fd, response)) {
+		std::cerr << "Connection to the assembler server lost" << std::endl;
+		close(fd);
+		return ERR_FOPEN;
+	}
+	close(fd);
+
+	auto command = request.get("command");
+	if (command == "stats") {
+		for (auto& field : response.fields) {
+			if (field.first != "status" && field.first != "length") {
+				std::cout << field.first << " " << field.second << std::endl;
+			}
+		}
+		return ERR_OK;
+	}
+	if (timing) {
+		std::cerr << "latency " << response.get("latency") << "us queue " << response.get("queue") << std::endl;
+	}
+	auto status = std::atoi(response.get("status").c_str());
+	auto messages = std::min<size_t>(std::strtoul(response.get("messages").c_str(), nullptr, 10), response.body.size());
+	std::cerr << response.body.substr(0, messages);
+	if (status != ERR_OK) {
+		printf("**** Application returned error code %d ****", status);
+		return status;
+	}
+	std::cout << response.body.substr(messages);
+	return ERR_OK;
+}
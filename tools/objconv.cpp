@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "../src/mappedfile.hpp"
+#include "../src/objformat.hpp"
+
+/*
+ * Converts object files between the text and the binary format.
+ * usage: objconv in.o -o out.o [-f text|bin]
+ * The input format is detected, the output defaults to the other format.
+ */
+int main(int argc, char *argv[]) {
+	std::string input, output, format;
+	for (auto i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if ((arg == "-o" || arg == "-f") && i + 1 < argc) {
+			(arg == "-o" ? output : format) = argv[++i];
+		} else {
+			input = arg;
+		}
+	}
+	if (input == "" || output == "" || (format != "" && format != "text" && format != "bin")) {
+		std::cerr << "usage: objconv in.o -o out.o [-f text|bin]" << std::endl;
+		return ERR_ARGUMENT;
+	}
+
+	MappedFile file;
+	if (!file.open(input)) {
+		std::cerr << "Unable to open " << input << std::endl;
+		return ERR_FOPEN;
+	}
+	auto data = file.data();
+	auto size = file.size();
+
+	assemblyResult result;
+	bool inputBinary = ObjectFormat::isBinary(data, size);
+	if (inputBinary) {
+		BinaryObject object;
+		if (!object.open(data, size)) {
+			std::cerr << "Malformed binary object " << input << std::endl;
+			return ERR_SYNTAX;
+		}
+		result = object.toResult();
+	} else {
+		std::istringstream text(std::string(file.text()));
+		if (!ObjectFormat::readText(text, result)) {
+			std::cerr << "Malformed text object " << input << std::endl;
+			return ERR_SYNTAX;
+		}
+	}
+	file.close();
+
+	if (format == "") {
+		format = inputBinary ? "text" : "bin";
+	}
+	std::ofstream out(output, std::ios::out | std::ios::binary);
+	if (!out.good()) {
+		std::cerr << "Unable to create " << output << std::endl;
+		return ERR_FOPEN;
+	}
+	if (format == "bin") {
+		ObjectFormat::writeBinary(result, out);
+	} else {
+		ObjectFormat::writeText(result, out);
+	}
+	return ERR_OK;
+}